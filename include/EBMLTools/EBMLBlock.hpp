@@ -0,0 +1,61 @@
+#ifndef EBMLBLOCK_H
+#define EBMLBLOCK_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace EBMLTools
+{
+	// Decoder for the payload of SimpleBlock and Block elements: track number, relative timecode,
+	// flags and the frame layout of Xiph, EBML or fixed size lacing. The block does not own any
+	// memory, frames are views into the buffer it was parsed from and live as long as that buffer.
+	class EBMLBlock
+	{
+		public:
+			enum class Lacing : uint8_t { None = 0, Xiph = 1, Fixed = 2, EBML = 3 };
+			struct Frame
+			{
+				const uint8_t * data;
+				size_t offset;	// From the start of the block data
+				size_t size;
+			};
+			static const size_t MaxHeaderLength = 12; // 8 byte track number, timecode, flags and lace count
+		private:
+			uint64_t trackNumber = 0;
+			int16_t timecode = 0;
+			uint8_t flags = 0;
+			bool simpleBlock = true;
+			size_t headerLength = 0;	// Up to the first frame when parsed in full, up to the lace count otherwise
+			size_t frameCount = 0;
+			size_t dataSize = 0;
+			bool headerOnly = false;
+			std::vector<Frame> frames;
+
+			size_t ParseFixedHeader(const uint8_t * data, size_t length);
+		public:
+			EBMLBlock();
+			EBMLBlock(const uint8_t * data, size_t size, bool simpleBlock = true);
+
+			void Parse(const uint8_t * data, size_t size, bool simpleBlock = true);	// Reuses the frame storage of a previous parse
+			void ParseHeader(const uint8_t * data, size_t length, size_t blockSize, bool simpleBlock = true); // Only the first bytes of the block, no frame views
+
+			uint64_t GetTrackNumber() const;
+			int16_t GetTimecode() const;
+			uint8_t GetFlags() const;
+			bool IsSimpleBlock() const;
+			bool IsKeyframe() const;	// SimpleBlock only, a Block is a keyframe when its BlockGroup has no ReferenceBlock
+			bool IsInvisible() const;
+			bool IsDiscardable() const;
+			Lacing GetLacing() const;
+			size_t GetHeaderLength() const;
+			size_t GetDataSize() const;
+			bool IsHeaderOnly() const;
+
+			size_t GetFrameCount() const;
+			const std::vector<Frame> & Frames() const;	// Empty for a header only parse
+			const Frame & GetFrame(size_t index) const;
+	};
+}
+
+#endif
\ No newline at end of file
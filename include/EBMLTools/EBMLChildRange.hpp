@@ -0,0 +1,58 @@
+#ifndef EBMLCHILDRANGE_H
+#define EBMLCHILDRANGE_H
+
+#include <memory>
+#include <iterator>
+
+#include "EBMLReadElement.hpp"
+
+namespace EBMLTools
+{
+	// Forward only view over the children of a master element. Child headers are decoded one
+	// at a time as the iterator advances, so breaking out of a range-for loop stops reading.
+	class EBMLChildRange
+	{
+		public:
+			class iterator
+			{
+				private:
+					friend class EBMLChildRange;
+					std::shared_ptr<const EBMLReadElement> parent; // Shared so iterators may outlive the range
+					uint64_t filter = 0;	// 0 matches every child
+					size_t next = 0;		// Position of the next child header
+					size_t end = 0;
+					std::unique_ptr<EBMLReadElement> current;
+
+					iterator(std::shared_ptr<const EBMLReadElement> parent, uint64_t filter, size_t start, size_t end);
+					void Advance();
+				public:
+					typedef std::input_iterator_tag iterator_category;
+					typedef EBMLReadElement value_type;
+					typedef std::ptrdiff_t difference_type;
+					typedef const EBMLReadElement * pointer;
+					typedef const EBMLReadElement & reference;
+
+					iterator() {}
+					iterator(const iterator & rhs);
+					iterator & operator= (const iterator & rhs);
+
+					const EBMLReadElement & operator*() const;
+					const EBMLReadElement * operator->() const;
+					iterator & operator++();
+
+					bool operator ==(const iterator & rhs) const;
+					bool operator !=(const iterator & rhs) const;
+			};
+
+			EBMLChildRange(const EBMLReadElement & parent);
+			EBMLChildRange(const EBMLReadElement & parent, const EBMLElement & filter);
+
+			iterator begin() const;
+			iterator end() const;
+		private:
+			std::shared_ptr<const EBMLReadElement> parent;
+			uint64_t filter = 0;
+	};
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,101 @@
+#ifndef EBMLCLUSTERSCANNER_H
+#define EBMLCLUSTERSCANNER_H
+
+#include <exception>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "EBMLReader.hpp"
+
+namespace EBMLTools
+{
+	// Parallel pass over the Clusters of a segment. The segment data is split into byte ranges and
+	// every worker reads its range with pread through its own window buffer. Workers other than the
+	// first resync on the Cluster ID and only accept a match whose size, Timecode child and following
+	// level 1 ID are plausible. A worker owns the clusters that start inside its range, so the
+	// partial results returned by Scan are in file order and cover every cluster exactly once.
+	// Clusters written with an unknown size end at the first ID that cannot be one of their children.
+	class EBMLClusterScanner
+	{
+		public:
+			struct BlockHeader
+			{
+				size_t position;	// SimpleBlock or BlockGroup
+				size_t size;		// Byte length of the SimpleBlock or BlockGroup
+				EBMLBlock block;	// Header only (EBMLBlock::IsHeaderOnly)
+				bool keyframe;		// SimpleBlock flag, or a BlockGroup without ReferenceBlock
+			};
+			struct Cluster
+			{
+				size_t position;
+				size_t dataPosition;	// First child, CueRelativePosition is counted from here
+				size_t size;
+				uint64_t timecode;
+				std::vector<BlockHeader> blocks;
+			};
+		private:
+			std::string fileName;
+			int fd = -1;
+			size_t segmentDataPosition = 0;
+			size_t segmentEnd = 0;
+			size_t windowSize = 4 * 1024 * 1024;
+			size_t minimumRangeSize = 16 * 1024 * 1024; // Smaller files use fewer workers
+
+			static const size_t NotFound = (size_t) -1;
+			struct Range { size_t start; size_t end; size_t first; size_t next; }; // first: where scanning began (NotFound if resync failed), next: first level 1 element past the range
+
+			std::vector<Range> Split(size_t threads) const;
+			void ScanRange(Range & range, bool exactStart, const std::function<void(const Cluster &)> & visit) const;
+			size_t Resync(size_t from, size_t end) const;
+		public:
+			EBMLClusterScanner(EBMLReader & reader);
+			~EBMLClusterScanner();
+
+			void SetWindowSize(size_t bytes);
+			void SetMinimumRangeSize(size_t bytes);
+
+			// visit(partial, cluster) is called for every cluster of a range with that range's partial
+			// result. threads == 0 uses one worker per hardware thread.
+			template <typename T>
+			std::vector<T> Scan(std::function<void(T &, const Cluster &)> visit, size_t threads = 0);
+	};
+
+	template <typename T>
+	std::vector<T> EBMLClusterScanner::Scan(std::function<void(T &, const Cluster &)> visit, size_t threads)
+	{
+		std::vector<Range> ranges = Split(threads);
+		std::vector<T> partials(ranges.size());
+		std::vector<std::exception_ptr> errors(ranges.size());
+		std::vector<std::thread> workers;
+		for (size_t i = 0; i < ranges.size(); i++)
+			workers.push_back(std::thread([&, i]() {
+				try { ScanRange(ranges[i], i == 0, [&](const Cluster & cluster) { visit(partials[i], cluster); }); }
+				catch (...) { errors[i] = std::current_exception(); }
+			}));
+		for (auto & worker : workers)
+			worker.join();
+		for (auto & error : errors)
+			if (error)
+				std::rethrow_exception(error);
+
+		// A resync that disagrees with where the previous range ended is redone from that boundary
+		for (size_t i = 1; i < ranges.size(); i++)
+		{
+			Range & previous = ranges[i - 1];
+			if (ranges[i].first == previous.next)
+				continue;
+			if (ranges[i].first == NotFound && previous.next >= ranges[i].end)
+			{
+				ranges[i].next = previous.next; // Nothing starts inside this range
+				continue;
+			}
+			partials[i] = T();
+			ranges[i].start = previous.next;
+			ScanRange(ranges[i], true, [&](const Cluster & cluster) { visit(partials[i], cluster); });
+		}
+		return partials;
+	}
+}
+
+#endif
\ No newline at end of file
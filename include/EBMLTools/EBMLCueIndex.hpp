@@ -0,0 +1,68 @@
+#ifndef EBMLCUEINDEX_H
+#define EBMLCUEINDEX_H
+
+#include <map>
+#include <vector>
+
+#include "EBMLReader.hpp"
+#include "EBMLWriteElement.hpp"
+
+namespace EBMLTools
+{
+	// In memory index of the Cues element for time based seeking. Cue points are kept per track
+	// as parallel arrays; every block of up to AnchorInterval entries stores its first time and
+	// cluster offset in full and the remaining entries as 32 bit deltas against them.
+	// Times are in TimecodeScale units (as CueTime), cluster positions are relative to the
+	// segment data (as CueClusterPosition) until resolved by SeekToTime.
+	class EBMLCueIndex
+	{
+		public:
+			struct CueEntry
+			{
+				uint64_t track;
+				uint64_t time;
+				uint64_t clusterPosition;
+				uint64_t relativePosition;	// 0 when absent or too large to index
+			};
+			static const size_t AnchorInterval = 64;
+		private:
+			struct TrackCues
+			{
+				std::vector<size_t> blockStart;		// Index of the first entry of each block
+				std::vector<uint64_t> blockTime;
+				std::vector<uint64_t> blockCluster;
+				std::vector<uint32_t> timeDelta;		// Against blockTime of the entry's block
+				std::vector<uint32_t> clusterDelta;		// Against blockCluster of the entry's block
+				std::vector<uint32_t> relativePosition;
+			};
+			std::map<uint64_t, TrackCues> tracks;
+			size_t segmentDataPosition = 0;
+			size_t size = 0;
+
+			static void Append(TrackCues & cues, uint64_t time, uint64_t clusterPosition, uint64_t relativePosition);
+			static size_t BlockOf(const TrackCues & cues, size_t index);
+			static CueEntry Decode(uint64_t track, const TrackCues & cues, size_t index);
+		public:
+			EBMLCueIndex();
+			EBMLCueIndex(EBMLReader & reader);	// Loads the Cues of the reader's file
+
+			void Load(EBMLReader & reader);		// Throws std::out_of_range when the file has no Cues
+			void Clear();
+
+			void Add(uint64_t track, uint64_t time, uint64_t clusterPosition, uint64_t relativePosition = 0);
+
+			size_t Size() const;
+			std::vector<uint64_t> GetTracks() const;
+			std::vector<CueEntry> Entries(uint64_t track) const;	// Ordered by time
+
+			void SetSegmentDataPosition(size_t position);
+			size_t GetSegmentDataPosition() const;
+
+			CueEntry FindCue(uint64_t track, uint64_t time) const;	// Last cue at or before time, or the first cue of the track
+			size_t SeekToTime(uint64_t track, uint64_t time) const;	// Absolute file position of the Cluster to start reading from
+
+			EBMLWriteElement CreateCuesElement() const;	// One CuePoint per distinct time, holding the CueTrackPositions of every track
+	};
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,46 @@
+#ifndef EBMLDURATIONESTIMATOR_H
+#define EBMLDURATIONESTIMATOR_H
+
+#include "EBMLReader.hpp"
+
+namespace EBMLTools
+{
+	// Duration of a segment without reading its Clusters: only the last one is decoded. It is found
+	// through the last CuePoint or the Cluster entries of the SeekHead when they point into the tail
+	// window, followed forward over the level 1 headers behind it, or else by scanning that window
+	// backwards for a Cluster ID whose header and Timecode child are plausible. The window doubles
+	// until a Cluster is found. For Cues and SeekHead it ends at the first element the SeekHead lists
+	// behind the Cluster they point at, so Tags, Attachments or Cues after the Clusters do not count.
+	class EBMLDurationEstimator
+	{
+		public:
+			enum class Source { Cues, SeekHead, TailScan };
+			struct Estimate
+			{
+				size_t clusterPosition;	// The last Cluster
+				uint64_t timecode;		// Its Timecode
+				int64_t lastBlock;		// Largest block timecode in it, relative to the Timecode
+				double duration;		// Timecode plus lastBlock, in TimecodeScale units like Info/Duration
+				Source source;
+			};
+		private:
+			EBMLReader & reader;
+			size_t segmentEnd = 0;
+			size_t tailWindow = 1024 * 1024;
+
+			size_t FromCues();
+			size_t FromSeekHead();
+			size_t FromTail();
+			bool IsCluster(size_t position);
+			size_t ClustersEnd(size_t position);
+			size_t FollowToLast(size_t position);
+		public:
+			EBMLDurationEstimator(EBMLReader & reader);
+
+			void SetTailWindow(size_t bytes);	// First window of the backward scan, 1 MiB by default
+			size_t FindLastCluster(Source & source); // Throws std::runtime_error if the segment has no Cluster
+			Estimate Compute();
+	};
+}
+
+#endif
\ No newline at end of file
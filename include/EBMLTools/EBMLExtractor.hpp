@@ -0,0 +1,45 @@
+#ifndef EBMLEXTRACTOR_H
+#define EBMLEXTRACTOR_H
+
+#include <string>
+
+#include "EBMLReader.hpp"
+
+namespace EBMLTools
+{
+	// Lossless cluster level cut: writes a new file with the Clusters of a time range, the Info,
+	// Tracks, Tags and Attachments of the source, and a new SeekHead and Cues pointing at the new
+	// offsets. Only the header, Timecode, Position and PrevSize of every Cluster are rewritten; the
+	// rest of it is copied with copy_file_range (in the kernel, or block sharing on reflink file
+	// systems) and falls back to pread and pwrite where that is not supported. A Cluster keeps its
+	// blocks whole, so the cut starts at the last Cluster at or before the start time.
+	class EBMLExtractor
+	{
+		public:
+			struct Result
+			{
+				size_t clusters = 0;
+				uint64_t firstTimecode = 0;	// Source Timecode of the first and last Cluster written
+				uint64_t lastTimecode = 0;
+				size_t cuePoints = 0;
+				size_t bytesCopied = 0;		// Cluster payload moved without decoding
+				bool offloaded = false;		// copy_file_range did the copying
+				size_t fileSize = 0;
+			};
+		private:
+			EBMLReader & reader;
+			bool rebase = true;
+			size_t threads = 0;
+		public:
+			EBMLExtractor(EBMLReader & reader);
+
+			void SetRebase(bool rebase);	// Shift the timestamps so the first Cluster starts at 0, on by default
+			void SetThreads(size_t threads);	// Workers of the cluster scan, 0 uses one per hardware thread
+
+			// Clusters overlapping [start, end) in nanoseconds; throws std::runtime_error if there are none, std::invalid_argument
+			// if output is the source file. A failed write removes output
+			Result Extract(const std::string & output, uint64_t start, uint64_t end);
+	};
+}
+
+#endif
\ No newline at end of file
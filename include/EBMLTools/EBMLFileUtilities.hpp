@@ -0,0 +1,36 @@
+#ifndef EBMLFILEUTILITIES_H
+#define EBMLFILEUTILITIES_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+namespace EBMLTools
+{
+	class EBMLWriteElement;
+
+	// File descriptor helpers shared by the writers that patch a file in place or rewrite it into a new one
+	class EBMLFileUtilities
+	{
+		public:
+			static const size_t SegmentHeaderLength = 12; // Of the rewritten files: 4 byte ID, size written with 8 bytes once the layout is known
+			static const size_t HolePunchMinimum = 64 * 1024; // Runs of zeros from this length on are punched out rather than written
+
+			// Copies length bytes between two descriptors with copy_file_range while offloaded is set (in the kernel,
+			// shared blocks on reflink file systems); it is cleared where that is refused and pread/pwrite used instead
+			static bool Copy(int in, size_t inPosition, int out, size_t outPosition, size_t length, bool & offloaded);
+			// pwrite until all length bytes are written, false on an error
+			static bool WriteAll(int fd, const uint8_t * data, size_t length, size_t position);
+			static bool WriteElement(int fd, const EBMLWriteElement & element, size_t position);
+			// Zeroes length bytes without writing them: a punched hole inside the file, a truncate past its end. False
+			// where the file system (or platform) cannot, nothing is changed then and the caller writes the zeros
+			static bool PunchHole(int fd, size_t position, size_t length);
+			// Makes out share the blocks of in (FICLONE on btrfs, XFS and other reflink file systems) and truncates it to
+			// the size of in. False with errno set where the file system (or platform) cannot
+			static bool Clone(int in, int out);
+			// fsync of the directory holding path, so that a file created, renamed or removed there survives a crash
+			static bool SyncDirectory(const std::string & path);
+	};
+}
+
+#endif
\ No newline at end of file
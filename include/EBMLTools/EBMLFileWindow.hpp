@@ -0,0 +1,47 @@
+#ifndef EBMLFILEWINDOW_H
+#define EBMLFILEWINDOW_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace EBMLTools
+{
+	// Sliding read buffer over a file descriptor, refilled with pread when a request falls outside
+	// of it. Used by the scanners that decode element headers in memory instead of going through
+	// EBMLReader, so several can work on the same file at once.
+	class EBMLFileWindow
+	{
+		public:
+			struct Header
+			{
+				uint64_t id;		// Encoded, as in the schema table
+				uint64_t dataSize;
+				size_t headerLength;
+				bool unknownSize;	// All size bits set
+			};
+		private:
+			int fd;
+			size_t capacity;
+			std::vector<uint8_t> buffer;
+			size_t start = 0;
+			size_t length = 0;
+		public:
+			EBMLFileWindow(int fd, size_t capacity);
+
+			// Bytes at position; available is set to the buffered byte count, at least wanted unless the file ends
+			const uint8_t * Get(size_t position, size_t wanted, size_t & available);
+
+			// End of a master written with an unknown size: the first ID at or after dataPosition that cannot be
+			// one of its children (a sibling or an element of a higher level), limit at the latest
+			size_t FindUnknownSizeEnd(uint64_t id, size_t dataPosition, size_t limit);
+
+			// Decodes an element header from memory, false if the bytes cannot be one (0x00 or 0xFF
+			// leading id byte, ids longer than 4 bytes, or a truncated header)
+			static bool ParseHeader(const uint8_t * data, size_t length, Header & header);
+			// The reverse into at least 12 bytes, returns the header length; sizeLength 0 picks the shortest that holds dataSize
+			static size_t EncodeHeader(uint64_t id, uint64_t dataSize, uint8_t * header, size_t sizeLength = 0);
+	};
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,54 @@
+#ifndef EBMLFOLLOWER_H
+#define EBMLFOLLOWER_H
+
+#include <set>
+#include <vector>
+
+#include "EBMLReader.hpp"
+#include "EBMLCueIndex.hpp"
+
+namespace EBMLTools
+{
+	// Follow mode for files that are still being written, such as DVR recordings. Wait() blocks until
+	// the file grows, noticed through inotify or, where that is not available, by polling its size.
+	// Update() extends the reader to the new size and indexes only the level 1 elements past the last
+	// complete one. An element is complete once it fits in the file and, if it has an unknown size,
+	// something that cannot be its child follows it. Keyframes are cued as by EBMLParser::GenerateCues.
+	class EBMLFollower
+	{
+		public:
+			struct Cluster
+			{
+				size_t position;
+				size_t size;
+				uint64_t timecode;
+			};
+		private:
+			EBMLReader & reader;
+			int notifyFd = -1;
+			size_t pollInterval = 250;	// Milliseconds
+			size_t position = 0;		// First level 1 element not indexed yet
+
+			std::vector<Cluster> clusters;
+			EBMLCueIndex cues;
+			std::set<uint64_t> cueTracks;
+			bool firstPerCluster = false;
+
+			void IndexTracks(const EBMLReadElement & tracks);
+			void IndexCluster(const EBMLReadElement & cluster);
+		public:
+			EBMLFollower(EBMLReader & reader);
+			~EBMLFollower();
+
+			bool Wait(size_t timeout);				// Milliseconds, true once the file is larger than the reader knows
+			size_t Update(bool finished = false);	// Returns the number of Clusters indexed, finished: the writer is done, the last element is complete
+
+			const std::vector<Cluster> & GetClusters() const;
+			const EBMLCueIndex & GetCues() const;
+
+			bool UsesInotify() const;
+			void SetPollInterval(size_t milliseconds);
+	};
+}
+
+#endif
\ No newline at end of file
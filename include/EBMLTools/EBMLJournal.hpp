@@ -0,0 +1,51 @@
+#ifndef EBMLJOURNAL_H
+#define EBMLJOURNAL_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace EBMLTools
+{
+	// Redo journal for crash safe in-place edits. The writes of a transaction are only collected (and
+	// read back through Overlay) until Commit, which writes them to <file>.journal followed by a commit
+	// record, syncs it and its directory, applies them to the file and syncs that: two barriers per
+	// transaction. The file is not touched before the journal is durable, so a journal without its commit
+	// record is dropped and a complete one is replayed, which is idempotent. Recover does either when a
+	// file is opened.
+	class EBMLJournal
+	{
+		public:
+			struct Write
+			{
+				size_t position;
+				size_t length;
+				std::vector<uint8_t> data; // Empty for zeros (Void data), which are journaled by length only
+			};
+		private:
+			std::string fileName;
+			std::vector<Write> writes;
+
+			static std::string PathFor(const std::string & fileName);
+			static bool Apply(int fd, const std::vector<Write> & writes);
+		public:
+			EBMLJournal(const std::string & fileName);
+
+			void Add(size_t position, const uint8_t * data, size_t length);
+			void AddZeros(size_t position, size_t length);
+			bool Empty() const;
+			void Clear();
+
+			// Patches buffer, the bytes at position as read from the file (count of them, short at its end),
+			// with the collected writes; returns the byte count now valid, writes past the end extend it
+			size_t Overlay(size_t position, uint8_t * buffer, size_t count, size_t length) const;
+			size_t End() const; // Past the last byte written, 0 without writes
+
+			void Commit();
+
+			// Replays a committed journal of fileName and removes it, drops an incomplete one; true if replayed
+			static bool Recover(const std::string & fileName);
+	};
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,38 @@
+#ifndef EBMLLAYOUTOPTIMIZER_H
+#define EBMLLAYOUTOPTIMIZER_H
+
+#include <string>
+
+#include "EBMLReader.hpp"
+
+namespace EBMLTools
+{
+	// Streaming rewrite into the layout players seek least in: SeekHead, Info, Tracks, Chapters, Tags,
+	// Cues, Attachments and any other level 1 element, a Void reserved for later edits, then the
+	// Clusters. Old SeekHeads and Voids are dropped. Clusters are not decoded: every run of Clusters
+	// that are adjacent in the source is moved with one large copy, and only the CueClusterPositions
+	// (and Cluster Position elements not covered by a CRC-32) are rewritten for the new offsets.
+	class EBMLLayoutOptimizer
+	{
+		public:
+			struct Result
+			{
+				size_t metadataLength = 0;	// SeekHead up to the end of the padding
+				size_t clusters = 0;
+				size_t copies = 0;			// Runs of adjacent Clusters, one copy each
+				size_t bytesCopied = 0;
+				bool offloaded = false;		// copy_file_range did the copying
+				size_t fileSize = 0;
+			};
+		private:
+			EBMLReader & reader;
+			size_t padding = 4096;
+		public:
+			EBMLLayoutOptimizer(EBMLReader & reader);
+
+			void SetPadding(size_t bytes);	// Size of the Void in front of the first Cluster, 4 KiB by default, 0 for none
+			Result Write(const std::string & output);	// Synced, with the permissions of the source; throws std::runtime_error for damaged or truncated files
+	};
+}
+
+#endif
\ No newline at end of file
@@ -3,31 +3,96 @@
 
 #include "EBMLReader.hpp"
 #include "EBMLWriteElement.hpp"
+#include "EBMLCueIndex.hpp"
+#include "EBMLJournal.hpp"
 
 namespace EBMLTools
 {
 	class EBMLParser : public EBMLReader
 	{
+		public:
+			enum class PaddingMode { None, Bytes, Percent };
+			static const size_t MaxPaddingPercent = 100;
+			static const size_t MaxPaddingBytes = 1024 * 1024 * 1024; // Per element written
+			enum class UpdateResult
+			{
+				Unchanged,	// The serialized element equals the one in the file, nothing was written
+				InPlace,	// Overwritten where it was, possibly grown into the Voids behind it
+				Relocated	// Moved into a Void or to the end of the file, the SeekHead was updated
+			};
+			struct Compaction
+			{
+				size_t voids = 0;		// Void elements in front of the first Cluster before compacting
+				size_t freeBytes = 0;	// Length of the single Void left
+				size_t movedBytes = 0;
+			};
 		private:
 			friend class EBMLWriteElement;
-			const uint8_t ZEROBYTE = 0x00;
+			// Held by UpdateElement, AddElement and CompactMetadata; only the outermost one acts. It takes the snapshot
+			// when snapshots are on, and on Commit applies the journal and drops the snapshot. Destroyed without Commit,
+			// the journaled writes are discarded or the file is rolled back to the snapshot
+			class Transaction
+			{
+				private:
+					EBMLParser & parser;
+					bool outermost = false;
+					bool taken = false;
+					bool committed = false;
+				public:
+					Transaction(EBMLParser & parser);
+					~Transaction();
+					void Commit();
+			};
+			bool snapshots = false;
+			std::unique_ptr<EBMLJournal> journal;
+			size_t transactionDepth = 0;
+			PaddingMode paddingMode = PaddingMode::None;
+			size_t padding = 0;
+			size_t mergeGap = 4096;
 			static EBMLWriteElement CreateVoid(uint64_t totalSize);
 			static uint8_t * CreateBlock(const uint64_t &value, const size_t &byteLength, bool encode = false);
 
 			void SetWritePosition(size_t position);
 			size_t GetWritePosition();
 			void RawWrite(const EBMLWriteElement & wele);
+			void Write(const uint8_t * data, size_t length); // At the write position, into the journal inside a journaled transaction
+			void WriteZeros(size_t length);
+			static void Serialize(const EBMLWriteElement & wele, std::vector<uint8_t> & bytes); // The bytes RawWrite writes
+			bool IsUnchanged(const EBMLReadElement & ele, const std::vector<uint8_t> & bytes);
+			void DiffWrite(size_t position, const std::vector<uint8_t> & bytes); // Writes only the ranges that differ from the file
+			void RewriteElement(const EBMLReadElement & ele, const EBMLWriteElement & wele); // At the write position, which is ele's
 			EBMLWriteElement CreateSeekHead();
 			void MergeConsecutiveVoidElements();
 			void UpdateSeekHead();
 			void AppendElement(EBMLWriteElement & wele);
 			void OverwriteElement(EBMLReadElement & ele, EBMLWriteElement & wele);
+			size_t PaddingFor(size_t length) const;
+			bool GrowInPlace(EBMLReadElement & ele, EBMLWriteElement & wele);
+			EBMLReadElement * FindVoid(std::vector<EBMLReadElement> & voids, size_t length) const;
+			void AppendPadded(EBMLWriteElement & wele);
+			std::string SnapshotPath() const;
+			void TakeSnapshot(); // Cloned under a temporary name, published by rename once it is on disk
+			bool SnapshotIsComplete() const; // EBML header and Segment present, the Segment within the file
+			void DropSnapshot();
+			void RestoreSnapshot();
+			void Reload();
+		protected:
+			size_t ReadBytes(uint8_t * buffer, size_t length); // Sees the writes journaled so far
 		public:
 			EBMLParser();
 			EBMLParser(std::string file, bool dataIntegrityCheck = false);
 			void OpenFile(std::string file, bool dataIntegrityCheck = false);
-			void UpdateElement(EBMLReadElement & ele, EBMLWriteElement & wele);
+			UpdateResult UpdateElement(EBMLReadElement & ele, EBMLWriteElement & wele);
 			void AddElement(EBMLWriteElement & wele);
+			Compaction CompactMetadata(); // Gathers the Voids in front of the first Cluster into one, moving the fewest bytes; the SeekHead is written once
+			void SetSnapshots(bool enabled); // Reflink snapshot (<file>.snapshot) around every edit, throws where the file system has no reflinks; a snapshot left by an interrupted edit is rolled back to first
+			void SetJournal(bool enabled); // Collects the writes of every edit and commits them through <file>.journal, replayed on open after a crash
+			void SetPadding(PaddingMode mode, size_t amount); // Void reserved behind every element UpdateElement or AddElement moves or appends: amount bytes, or amount percent of its length; throws std::invalid_argument above MaxPaddingPercent or MaxPaddingBytes
+			void SetMergeGap(size_t bytes); // Changed ranges of an element rewritten in place that are at most this far apart are written as one, 4096 by default
+			EBMLCueIndex GenerateCues(); // Indexes the keyframes of the video tracks (or of every track when there is no video) and writes the Cues element
+			void WriteDuration(double duration); // Sets Info/Duration (TimecodeScale units), adding it when it is missing
+
+			static EBMLWriteElement CreateSeekHead(const std::map<size_t, uint64_t> & entries, size_t segmentDataPosition); // position, id like seekHead; a Seek per entry in position order
 	};
 }
 
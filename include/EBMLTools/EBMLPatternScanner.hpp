@@ -0,0 +1,39 @@
+#ifndef EBMLPATTERNSCANNER_H
+#define EBMLPATTERNSCANNER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace EBMLTools
+{
+	// Finds the first occurrence of any of a small set of 4 byte element IDs (Cluster, Cues, Tags, ...)
+	// in a buffer. On x86 the first two bytes of every ID are compared 32 (AVX2) or 16 (SSE2) positions
+	// at a time and only the candidates are checked in full; other CPUs use a scalar loop.
+	class EBMLPatternScanner
+	{
+		public:
+			enum class Implementation { Scalar, SSE2, AVX2 };
+			static const size_t NotFound = (size_t) -1;
+		private:
+			std::vector<uint32_t> patterns;
+			bool firstBytes[256] = {};
+			Implementation implementation;
+
+			bool Matches(const uint8_t * data, size_t & index) const;
+			size_t FindScalar(const uint8_t * data, size_t start, size_t length, size_t & index) const;
+			size_t FindSSE2(const uint8_t * data, size_t length, size_t & index) const;
+			size_t FindAVX2(const uint8_t * data, size_t length, size_t & index) const;
+		public:
+			EBMLPatternScanner(const std::vector<uint64_t> & ids); // Throws std::invalid_argument for ids that are not 4 bytes long
+
+			// Offset of the first match starting in data[0, length - 4], or NotFound; index is set to the matching id
+			size_t Find(const uint8_t * data, size_t length, size_t & index) const;
+
+			static Implementation BestImplementation();	// Checked against the running CPU
+			Implementation GetImplementation() const;
+			void SetImplementation(Implementation implementation); // Falls back to the best supported one
+	};
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,47 @@
+#ifndef EBMLQUERY_H
+#define EBMLQUERY_H
+
+#include <string>
+#include <vector>
+
+#include "EBMLElement.hpp"
+
+namespace EBMLTools
+{
+	class EBMLReadElement;
+
+	// Compact path query over the schema, e.g.
+	//   Segment/Tags/Tag/SimpleTag[TagName="TITLE"]/TagString
+	//   Tracks/TrackEntry[TrackType=2]
+	// A path that does not start at a root element is anchored through its schema parents.
+	// Predicates test direct children of a master step: [Name=value] matches when any such child
+	// equals value, [Name!=value] when none does. Strings are quoted, numbers are not.
+	class EBMLQuery
+	{
+		public:
+			struct Predicate
+			{
+				EBMLElement element;
+				bool negate;
+				std::string value;
+			};
+			struct Step
+			{
+				EBMLElement element;
+				std::vector<Predicate> predicates;
+			};
+		private:
+			std::string query;
+			std::vector<Step> steps;
+
+			static bool MatchesPredicate(const Predicate & predicate, const EBMLReadElement & element);
+		public:
+			EBMLQuery(const std::string & query);
+
+			const std::vector<Step> & GetSteps() const;
+			bool Matches(size_t depth, const EBMLReadElement & element) const; // Element name and predicates of step[depth]
+			std::string ToString() const;
+	};
+}
+
+#endif
\ No newline at end of file
@@ -11,14 +11,19 @@ namespace EBMLTools
 {
 	class EBMLReader;
 	class EBMLWriteElement;
+	class EBMLChildRange;
 
 	class EBMLReadElement : public EBMLElementTemplate
 	{
 		private:
+			friend class EBMLReader;
+			friend class EBMLChildRange;
 			EBMLReader * reader = 0;
 			EBMLReadElement(const EBMLElement &e);
+			EBMLReadElement(EBMLReader * reader, const EBMLElement & base, uint64_t dataSize, uint8_t dataSizeByteLength, size_t position, const EBMLReadElement * parent);
 			size_t position;
 			size_t parentPosition;
+			bool unknownSize = false;
 		public:
 			EBMLReadElement(EBMLReader * reader, const EBMLElement & base, uint64_t dataSize, uint8_t dataSizeByteLength, size_t position);
 
@@ -36,9 +41,13 @@ namespace EBMLTools
 			size_t GetElementByteLength() const;
 			size_t GetElementDataSize() const;
 			size_t GetElementDataSizeByteLength() const;
+			bool IsUnknownSize() const;	// Written with all size bits set, the data size is resolved from the children
 
 			std::vector<EBMLReadElement> Children() const;
 			std::vector<EBMLReadElement> Children(const EBMLElement & filter) const;
+			EBMLChildRange ChildRange() const;								// Lazy, decodes one child header at a time
+			EBMLChildRange ChildRange(const EBMLElement & filter) const;
+			EBMLReadElement FindFirstChild(const EBMLElement & query) const;	// Stops at the first match, throws std::out_of_range if there is none
 			EBMLReadElement FirstChild() const;
 			EBMLReadElement Parent() const;
 
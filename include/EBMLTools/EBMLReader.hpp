@@ -5,6 +5,10 @@
 #include <fstream>
 #include <memory>
 #include "EBMLReadElement.hpp"
+#include "EBMLVisitor.hpp"
+#include "EBMLChildRange.hpp"
+#include "EBMLQuery.hpp"
+#include "EBMLBlock.hpp"
 
 
 namespace EBMLTools
@@ -13,18 +17,27 @@ namespace EBMLTools
 	{
 		private:
 			friend class EBMLReadElement;
+			friend class EBMLChildRange;
+			friend class EBMLTrackReader;
+			friend class EBMLFollower;
+			friend class EBMLDurationEstimator;
+			friend class EBMLLayoutOptimizer;
 			enum class ReadMode { Normal, Descende }; // Normal read mode does not descende into child elements.. it will skip to next element on the same level.
 
 			static uint8_t ParseBlockLength(uint8_t value);
 			static uint8_t ParseBlockData(uint8_t byte, uint8_t blockLength);
+
+			uint64_t ResolveUnknownSize(const EBMLElement & element, size_t position, size_t dataPosition); // Data size of a master written with all size bits set
 		protected:
 			std::string fileName = "";
 			size_t fileSize = 0;
+			size_t segmentDataPosition = 0; // First byte after the Segment header, CueClusterPosition and SeekPosition are relative to it
 			std::unique_ptr<EBMLReadElement> firstSeekHead = NULL;
 			std::map<size_t, uint64_t> seekHead; // position, id
 			uint8_t maxIdLength = 4;	// Default as per EBML spec (The max EBML ID byte length to read)
 			uint8_t maxSizeLength = 4;	// Default per EBML spec (The max EBML Size byte length to read) **obviously 64bit files (>4GB) will set this to 8
 			std::map<size_t, std::pair<size_t, uint64_t>> parentStructure; // position, size, id
+			std::map<size_t, uint64_t> resolvedSizes; // position, data size of the elements with an unknown size (live recordings and streams)
 			bool integrityCheck = false;
 			
 			mutable std::fstream fileStream;
@@ -34,10 +47,15 @@ namespace EBMLTools
 			size_t GetReadPosition();
 			uint64_t ReadNextBlock(uint8_t &length, bool isSize = false);
 			uint8_t GetNextByte();
+			size_t ReadRaw(size_t position, uint8_t * buffer, size_t length); // Does not move the read position, returns the byte count read
+			virtual size_t ReadBytes(uint8_t * buffer, size_t length); // At the read position, which it advances; every read of the file goes through here
 
 			EBMLReadElement ReadElement(ReadMode mode = ReadMode::Normal);
+			EBMLReadElement ReadElement(const EBMLReadElement & parent, ReadMode mode = ReadMode::Normal); // Parent is known, skips the parentStructure lookup
+			EBMLReadElement ReadElement(const EBMLReadElement * parent, ReadMode mode);
 			EBMLReadElement GetElement(size_t fileposition);
 			EBMLReadElement operator [] (size_t fileposition);
+			void Walk(size_t start, size_t end, EBMLVisitor & visitor);
 		public:
 			EBMLReader();
 			EBMLReader(std::string file, bool dataIntegrityCheck = false);
@@ -47,6 +65,8 @@ namespace EBMLTools
 			void CloseFile();
 
 			const std::string GetFilename() const;
+			size_t GetSegmentDataPosition() const;
+			size_t Refresh(); // Picks up bytes appended since the file was opened (follow mode), returns the file size
 
 			void DisableDataIntegrityCheck();
 			void EnableDataIntegrityCheck();
@@ -55,6 +75,14 @@ namespace EBMLTools
 			std::vector<EBMLReadElement> GetRootElements(const EBMLElement & filter);
 			std::vector<EBMLReadElement> Search(const EBMLElement & query);
 			std::vector<EBMLReadElement> FastSearch(const EBMLElement & query);
+			std::vector<EBMLReadElement> Query(const EBMLQuery & query);
+			std::vector<EBMLReadElement> Query(const std::string & query);
+
+			void Walk(EBMLVisitor & visitor);
+			void Walk(const EBMLReadElement & root, EBMLVisitor & visitor);
+
+			EBMLBlock ReadBlockHeader(const EBMLReadElement & block); // SimpleBlock or Block, reads at most EBMLBlock::MaxHeaderLength bytes
+			void ReadBlock(const EBMLReadElement & block, EBMLBlock & result, std::vector<uint8_t> & buffer); // Frames of result are views into buffer, which is reused
 	}; 
 }
 
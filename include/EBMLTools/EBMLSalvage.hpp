@@ -0,0 +1,63 @@
+#ifndef EBMLSALVAGE_H
+#define EBMLSALVAGE_H
+
+#include <string>
+#include <vector>
+
+#include "EBMLFileWindow.hpp"
+#include "EBMLPatternScanner.hpp"
+
+namespace EBMLTools
+{
+	// Recovery pass for files EBMLReader refuses to open. The level 1 elements of the segment are
+	// walked with pread; an element is accepted when its ID is known at level 1, it fits in the
+	// segment and its children chain up to exactly its size. Anything else is reported as damaged
+	// up to the next accepted Cluster, Cues, Tags, SeekHead, Info, Tracks, Chapters or Attachments
+	// header, which is searched for with EBMLPatternScanner.
+	class EBMLSalvage
+	{
+		public:
+			struct Element
+			{
+				uint64_t id;
+				size_t position;
+				size_t size;		// Header included
+			};
+			struct DamagedRange
+			{
+				size_t start;
+				size_t end;
+			};
+			struct Report
+			{
+				size_t segmentDataPosition = 0;
+				size_t segmentEnd = 0;
+				bool truncated = false;		// The segment size points past the end of the file
+				std::vector<Element> elements;	// Accepted level 1 elements in file order
+				std::vector<DamagedRange> damaged;
+			};
+		private:
+			std::string fileName;
+			int fd = -1;
+			size_t fileSize = 0;
+			size_t windowSize = 4 * 1024 * 1024;
+			EBMLPatternScanner scanner;
+
+			bool Accept(EBMLFileWindow & window, size_t position, size_t segmentEnd, EBMLFileWindow::Header & header) const;
+			size_t Resync(size_t from, size_t segmentEnd) const;
+		public:
+			EBMLSalvage(std::string fileName);
+			~EBMLSalvage();
+
+			Report Scan();
+
+			// Writes a SeekHead for the Info, Tracks, Tags, Cues, Chapters and Attachments found by Scan at the
+			// start of the segment, over the SeekHead, Void and damaged bytes in front of the first other
+			// element. Returns false (and writes nothing) if the new SeekHead does not fit there.
+			bool RebuildSeekHead(const Report & report);
+
+			EBMLPatternScanner & GetPatternScanner();
+	};
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,71 @@
+#ifndef EBMLSTREAMWRITER_H
+#define EBMLSTREAMWRITER_H
+
+#include <string>
+#include <vector>
+
+#include "EBMLElement.hpp"
+
+namespace EBMLTools
+{
+	// Writes EBML straight to a file descriptor, without an EBMLWriteElement tree in memory. A master's
+	// size is reserved at a chosen width when it begins and back-patched when it ends, so its children,
+	// binary data copied from another descriptor included, are never resident. A master can start
+	// with a CRC-32 that is computed while its data streams past; the size and CRC fields patched inside
+	// it later are corrected for by shifting the CRC of their change over the bytes written after them.
+	class EBMLStreamWriter
+	{
+		public:
+			static const uint64_t UnknownLength = (uint64_t) -1;
+		private:
+			struct Correction
+			{
+				uint32_t crc;	// Of the changed bytes alone (no initial value, no final xor)
+				size_t end;		// Offset past them in the CRC'd data
+			};
+			struct OpenMaster
+			{
+				std::string name;
+				size_t sizePosition;
+				size_t sizeLength;
+				size_t dataPosition;
+				bool crc;
+				size_t crcStart;	// First byte after the CRC-32 element
+				uint32_t running;	// CRC of the bytes written since crcStart, as they were written
+				std::vector<Correction> corrections;
+			};
+			int fd;
+			size_t position;
+			std::vector<uint8_t> buffer;	// Not yet written, starts at bufferStart
+			size_t bufferStart;
+			size_t bufferCapacity = 1024 * 1024;
+			std::vector<OpenMaster> masters;
+
+			void Append(const uint8_t * data, size_t length);
+			void Patch(size_t at, const uint8_t * before, const uint8_t * after, size_t length);
+			size_t WriteHeader(const EBMLElement & element, uint64_t dataSize, size_t sizeLength = 0); // Returns the size field position
+			void Check(const EBMLElement & element, ElementType type, const std::string & method) const;
+			static void EncodeSize(uint64_t dataSize, size_t sizeLength, uint8_t * bytes);
+		public:
+			EBMLStreamWriter(int fd, size_t position);	// Writes from position on, fd is not closed
+			~EBMLStreamWriter();						// Flushes, open masters stay as they are
+
+			void BeginMaster(const EBMLElement & element, size_t sizeLength = 8, bool crc = false); // sizeLength bytes are reserved for the size (1 to 8)
+			void EndMaster();
+
+			void WriteUint(const EBMLElement & element, uint64_t value);
+			void WriteInt(const EBMLElement & element, int64_t value);
+			void WriteFloat(const EBMLElement & element, double value);
+			void WriteString(const EBMLElement & element, const std::string & value);	// String and UTF8 elements
+			void WriteBinary(const EBMLElement & element, const uint8_t * data, size_t length);
+			// Copies from source with read(), so a pipe or socket works; UnknownLength reads to its end, with
+			// the size reserved at 8 bytes and back-patched. Returns the byte count copied
+			uint64_t WriteBinary(const EBMLElement & element, int source, uint64_t length = UnknownLength);
+
+			void SetBufferSize(size_t bytes);
+			size_t GetPosition() const;	// Where the next element is written
+			void Flush();
+	};
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,62 @@
+#ifndef EBMLTRACKREADER_H
+#define EBMLTRACKREADER_H
+
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+
+#include "EBMLReader.hpp"
+
+namespace EBMLTools
+{
+	// Pull style demuxer over the Clusters of a segment. Next() yields the frames of the selected
+	// tracks in file order; blocks of other tracks are recognised from their header and skipped
+	// without reading the payload. Frame data points into a buffer owned by the track reader and is
+	// only valid until the next call to Next() or Seek().
+	class EBMLTrackReader
+	{
+		public:
+			struct Frame
+			{
+				uint64_t track;
+				int64_t timestamp;		// TimecodeScale units, laced frames are spaced by the track's DefaultDuration
+				bool keyframe;
+				const uint8_t * data;
+				size_t size;
+				size_t blockPosition;	// SimpleBlock or BlockGroup the frame belongs to
+			};
+		private:
+			EBMLReader & reader;
+			std::set<uint64_t> tracks;					// Empty selects every track
+			std::map<uint64_t, uint64_t> defaultDurations;	// Track number, nanoseconds
+			uint64_t timecodeScale = 1000000;
+
+			std::unique_ptr<EBMLReadElement> segment;
+			size_t segmentEnd = 0;
+			std::unique_ptr<EBMLReadElement> cluster;
+			bool clusterCached = false;
+			size_t clusterEnd = 0;
+			uint64_t clusterTimecode = 0;
+			size_t position = 0;	// Next element to read
+
+			std::vector<uint8_t> buffer;
+			EBMLBlock block;
+			size_t blockPosition = 0;
+			bool blockKeyframe = false;
+			size_t frameIndex = 0;
+
+			bool Selected(uint64_t track) const;
+			bool NextBlock();
+			void CloseCluster();
+		public:
+			EBMLTrackReader(EBMLReader & reader, const std::vector<uint64_t> & tracks = {});
+			~EBMLTrackReader();
+
+			bool Next(Frame & frame);	// False once the last Cluster has been read
+			void Seek(size_t clusterPosition);	// Continue at the Cluster at this absolute position, e.g. from EBMLCueIndex::SeekToTime
+			uint64_t GetTimecodeScale() const;
+	};
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,46 @@
+#ifndef EBMLTRACKSTATISTICS_H
+#define EBMLTRACKSTATISTICS_H
+
+#include <map>
+#include <vector>
+
+#include "EBMLReader.hpp"
+
+namespace EBMLTools
+{
+	// Per track packet, keyframe, byte and bitrate statistics computed in one EBMLClusterScanner pass
+	// from block headers only. Bytes are counted into buckets of a tenth of the bitrate window, so
+	// the partial results of the scan ranges can be added together before the window is slid over them.
+	class EBMLTrackStatistics
+	{
+		public:
+			struct Track
+			{
+				uint64_t track;
+				uint64_t blocks;
+				uint64_t packets;		// Frames, laced blocks count every frame
+				uint64_t keyframes;
+				uint64_t bytes;			// Block payload without the block header (lace sizes are included)
+				int64_t firstTimestamp;	// Nanoseconds
+				int64_t lastTimestamp;
+				int64_t duration;		// Last minus first timestamp, plus the DefaultDuration of the track when set
+				double averageBitrate;	// Bits per second over the duration
+				double peakBitrate;		// Highest bits per second of any window
+			};
+		private:
+			EBMLReader & reader;
+			uint64_t timecodeScale = 1000000;
+			std::map<uint64_t, uint64_t> defaultDurations;	// Track number, nanoseconds
+			uint64_t window = 1000000000;					// Nanoseconds
+			size_t threads = 0;
+		public:
+			EBMLTrackStatistics(EBMLReader & reader);
+
+			void SetWindow(uint64_t nanoseconds);	// Length of the peak bitrate window, one second by default
+			void SetThreads(size_t threads);		// 0 uses one scan worker per hardware thread
+
+			std::vector<Track> Compute();			// Ordered by track number
+	};
+}
+
+#endif
\ No newline at end of file
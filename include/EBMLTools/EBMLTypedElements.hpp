@@ -0,0 +1,115 @@
+#ifndef EBMLTYPEDELEMENTS_H
+#define EBMLTYPEDELEMENTS_H
+
+#include <set>
+#include <string>
+#include <vector>
+#include <ctime>
+
+#include "EBMLReadElement.hpp"
+
+namespace EBMLTools
+{
+	// Typed views of common Matroska masters. Each Decode makes a single pass over the children of
+	// the master (nested masters are decoded in the same pass); fields are bound to schema elements
+	// by name and default to the values given by the Matroska spec when the child is absent.
+	struct EBMLTypedElement
+	{
+		size_t position = 0;
+		std::set<uint64_t> present;	// Ids of the children that were found
+
+		bool Has(const EBMLElement & child) const;
+		bool Has(const std::string & childName) const;
+	};
+
+	struct SegmentInfo : EBMLTypedElement
+	{
+		uint64_t timecodeScale = 1000000;
+		double duration = 0;
+		uint64_t dateUTC = 0;	// Nanoseconds since 2001-01-01T00:00:00 UTC
+		std::string title;
+		std::string muxingApp;
+		std::string writingApp;
+
+		tm * GetDateUTC() const;
+
+		static SegmentInfo Decode(const EBMLReadElement & info);
+	};
+
+	struct AudioSettings : EBMLTypedElement
+	{
+		double samplingFrequency = 8000;
+		double outputSamplingFrequency = 0;
+		uint64_t channels = 1;
+		uint64_t bitDepth = 0;
+
+		static AudioSettings Decode(const EBMLReadElement & audio);
+	};
+
+	struct VideoSettings : EBMLTypedElement
+	{
+		uint64_t flagInterlaced = 0;
+		uint64_t stereoMode = 0;
+		uint64_t pixelWidth = 0;
+		uint64_t pixelHeight = 0;
+		uint64_t displayWidth = 0;
+		uint64_t displayHeight = 0;
+		uint64_t displayUnit = 0;
+
+		static VideoSettings Decode(const EBMLReadElement & video);
+	};
+
+	struct TrackEntry : EBMLTypedElement
+	{
+		uint64_t trackNumber = 0;
+		uint64_t trackUID = 0;
+		uint64_t trackType = 0;
+		bool flagEnabled = true;
+		bool flagDefault = true;
+		bool flagForced = false;
+		bool flagLacing = true;
+		uint64_t defaultDuration = 0;
+		std::string name;
+		std::string language = "eng";
+		std::string codecID;
+		std::string codecName;
+		uint64_t codecDelay = 0;
+		uint64_t seekPreRoll = 0;
+		AudioSettings audio;
+		VideoSettings video;
+
+		static TrackEntry Decode(const EBMLReadElement & trackEntry);
+		static std::vector<TrackEntry> DecodeAll(const EBMLReadElement & tracks);
+	};
+
+	struct SimpleTag : EBMLTypedElement
+	{
+		std::string name;
+		std::string language = "und";
+		bool isDefault = true;
+		std::string value;
+		std::vector<SimpleTag> children;
+
+		static SimpleTag Decode(const EBMLReadElement & simpleTag);
+	};
+
+	struct Tag : EBMLTypedElement
+	{
+		// Targets
+		uint64_t targetTypeValue = 50;
+		std::string targetType;
+		std::vector<uint64_t> trackUIDs;
+		std::vector<uint64_t> editionUIDs;
+		std::vector<uint64_t> chapterUIDs;
+		std::vector<uint64_t> attachmentUIDs;
+
+		std::vector<SimpleTag> simpleTags;
+
+		bool TargetsAll() const; // No target restrictions, the tag applies to the whole segment
+
+		static Tag Decode(const EBMLReadElement & tag);
+		static std::vector<Tag> DecodeAll(const EBMLReadElement & tags);
+	};
+}
+
+#endif
\ No newline at end of file
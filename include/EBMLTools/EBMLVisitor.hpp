@@ -0,0 +1,28 @@
+#ifndef EBMLVISITOR_H
+#define EBMLVISITOR_H
+
+#include "EBMLReadElement.hpp"
+
+namespace EBMLTools
+{
+	enum class VisitResult
+	{
+		Continue,		// Keep walking (descend into the master if this was an EnterMaster call)
+		SkipChildren,	// Do not descend into this master; continue with its next sibling
+		Stop			// Abort the walk
+	};
+
+	// Callbacks for EBMLReader::Walk. The walk is a single forward pass over the file,
+	// only the chain of currently open master elements is kept in memory.
+	class EBMLVisitor
+	{
+		public:
+			virtual ~EBMLVisitor() {}
+
+			virtual VisitResult EnterMaster(const EBMLReadElement & element) { return VisitResult::Continue; }
+			virtual VisitResult Element(const EBMLReadElement & element) { return VisitResult::Continue; }	// Any non master element
+			virtual VisitResult ExitMaster(const EBMLReadElement & element) { return VisitResult::Continue; }	// Not called for skipped masters
+	};
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,53 @@
+#ifndef EBMLVOIDREPORT_H
+#define EBMLVOIDREPORT_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "EBMLReader.hpp"
+
+namespace EBMLTools
+{
+	// Space wasted by Void elements, which EBMLReader::Search refuses as global elements. One
+	// EBMLReader::Walk counts every Void by level (the Segment is level 0, its children level 1).
+	// Cluster children are skipped unless SetScanClusters is set, so only headers in front of the
+	// blocks are read. Tree() reports every matroska file under a directory with a pool of workers,
+	// each owning its own reader; a file that cannot be read gets an error instead of a report.
+	class EBMLVoidReport
+	{
+		public:
+			struct Level
+			{
+				size_t voids = 0;
+				size_t bytes = 0;
+			};
+			struct Report
+			{
+				std::string fileName;
+				std::string error;				// Empty when the file was read
+				size_t fileSize = 0;
+				std::map<size_t, Level> levels;	// Level, Voids found at it
+				size_t voids = 0;
+				size_t bytes = 0;				// Reclaimable, all Void bytes
+				size_t preClusterBytes = 0;		// Void bytes between the Segment data start and the first Cluster
+				size_t largestPreClusterVoid = 0;
+				bool clustersScanned = false;
+			};
+		private:
+			std::string fileName;
+			bool scanClusters = false;
+		public:
+			EBMLVoidReport(const std::string & fileName);
+
+			void SetScanClusters(bool scan);	// Also count Voids inside Clusters, every block header is read
+
+			Report Compute();
+
+			// Every .mkv, .mka, .mks, .mk3d and .webm file below directory, ordered by path. threads == 0
+			// uses one worker per hardware thread.
+			static std::vector<Report> Tree(const std::string & directory, bool scanClusters = false, size_t threads = 0); // Follows symbolic links, visiting every directory and file once
+	};
+}
+
+#endif
\ No newline at end of file
@@ -13,6 +13,7 @@ namespace EBMLTools
 	{
 		private:
 			friend class EBMLParser;
+			friend class EBMLSalvage;
 			static uint8_t DetermineByteLengthOfValue(uint64_t size);
 			uint8_t * data = { NULL };
 			mutable std::vector<std::unique_ptr<EBMLWriteElement>> children;
@@ -0,0 +1,177 @@
+#include <EBMLTools/EBMLBlock.hpp>
+
+#include <stdexcept>
+#include <string>
+
+namespace EBMLTools
+{
+	namespace
+	{
+		// Reads an EBML variable size integer, returns false when it does not fit in length
+		bool ReadVint(const uint8_t * data, size_t length, size_t & index, uint64_t & value, uint8_t & vintLength)
+		{
+			if (index >= length || data[index] == 0)
+				return false;
+			vintLength = 1;
+			while (!(data[index] & (0x80 >> (vintLength - 1))))
+				vintLength++;
+			if (index + vintLength > length)
+				return false;
+			value = data[index] & (0xFF >> vintLength);
+			for (uint8_t i = 1; i < vintLength; i++)
+				value = (value << 8) | data[index + i];
+			index += vintLength;
+			return true;
+		}
+
+		// Whether a laced frame of frameSize fits behind index next to the lacedSize bytes of the frames before it,
+		// checked as each size is read so the sum cannot wrap
+		bool FrameFits(size_t size, size_t index, size_t lacedSize, uint64_t frameSize)
+		{
+			return lacedSize <= size - index && frameSize <= size - index - lacedSize;
+		}
+	}
+
+	EBMLBlock::EBMLBlock() {}
+	EBMLBlock::EBMLBlock(const uint8_t * data, size_t size, bool simpleBlock) { Parse(data, size, simpleBlock); }
+
+	size_t EBMLBlock::ParseFixedHeader(const uint8_t * data, size_t length)
+	{
+		size_t index = 0;
+		uint8_t trackLength;
+		if (!ReadVint(data, length, index, trackNumber, trackLength) || index + 3 > length)
+			throw std::runtime_error("EBMLBlock::Parse(). Block is too short for its header.");
+		timecode = (int16_t) ((data[index] << 8) | data[index + 1]);
+		flags = data[index + 2];
+		return index + 3;
+	}
+
+	void EBMLBlock::Parse(const uint8_t * data, size_t size, bool simpleBlock)
+	{
+		this->simpleBlock = simpleBlock;
+		dataSize = size;
+		headerOnly = false;
+		frames.clear();
+
+		size_t index = ParseFixedHeader(data, size);
+		Lacing lacing = GetLacing();
+		if (lacing == Lacing::None)
+		{
+			headerLength = index;
+			frameCount = 1;
+			frames.push_back(Frame { data + index, index, size - index });
+			return;
+		}
+
+		if (index >= size)
+			throw std::runtime_error("EBMLBlock::Parse(). Laced block has no frame count.");
+		frameCount = (size_t) data[index++] + 1;
+		frames.reserve(frameCount);
+
+		// Sizes of every frame but the last are stored first, offsets are filled in once the lace header ends
+		size_t lacedSize = 0;
+		switch (lacing)
+		{
+			case Lacing::Xiph:
+				for (size_t i = 0; i < frameCount - 1; i++)
+				{
+					size_t frameSize = 0;
+					uint8_t byte;
+					do
+					{
+						if (index >= size)
+							throw std::runtime_error("EBMLBlock::Parse(). Xiph lace sizes run past the end of the block.");
+						byte = data[index++];
+						frameSize += byte;
+					} while (byte == 0xFF);
+					if (!FrameFits(size, index, lacedSize, frameSize))
+						throw std::runtime_error("EBMLBlock::Parse(). Lace sizes exceed the block size.");
+					frames.push_back(Frame { NULL, 0, frameSize });
+					lacedSize += frameSize;
+				}
+				break;
+			case Lacing::EBML:
+			{
+				uint64_t value;
+				uint8_t vintLength;
+				if (!ReadVint(data, size, index, value, vintLength))
+					throw std::runtime_error("EBMLBlock::Parse(). EBML lace sizes run past the end of the block.");
+				if (!FrameFits(size, index, lacedSize, value))
+					throw std::runtime_error("EBMLBlock::Parse(). Lace sizes exceed the block size.");
+				int64_t frameSize = value; // At most the block size, so a signed difference cannot overflow it
+				frames.push_back(Frame { NULL, 0, (size_t) frameSize });
+				lacedSize += frameSize;
+				for (size_t i = 1; i < frameCount - 1; i++)
+				{
+					if (!ReadVint(data, size, index, value, vintLength))
+						throw std::runtime_error("EBMLBlock::Parse(). EBML lace sizes run past the end of the block.");
+					frameSize += (int64_t) value - ((int64_t(1) << (7 * vintLength - 1)) - 1); // Signed difference to the previous size
+					if (frameSize < 0)
+						throw std::runtime_error("EBMLBlock::Parse(). Negative EBML lace size.");
+					if (!FrameFits(size, index, lacedSize, frameSize))
+						throw std::runtime_error("EBMLBlock::Parse(). Lace sizes exceed the block size.");
+					frames.push_back(Frame { NULL, 0, (size_t) frameSize });
+					lacedSize += frameSize;
+				}
+				break;
+			}
+			case Lacing::Fixed:
+				if ((size - index) % frameCount != 0)
+					throw std::runtime_error("EBMLBlock::Parse(). Fixed lacing does not divide the block into " + std::to_string(frameCount) + " frames.");
+				frames.assign(frameCount - 1, Frame { NULL, 0, (size - index) / frameCount });
+				lacedSize = (size - index) / frameCount * (frameCount - 1);
+				break;
+			default:
+				break;
+		}
+
+		headerLength = index;
+		if (lacedSize > size - index)
+			throw std::runtime_error("EBMLBlock::Parse(). Lace sizes exceed the block size.");
+		for (auto & frame : frames)
+		{
+			frame.data = data + index;
+			frame.offset = index;
+			index += frame.size;
+		}
+		frames.push_back(Frame { data + index, index, size - index });
+	}
+
+	void EBMLBlock::ParseHeader(const uint8_t * data, size_t length, size_t blockSize, bool simpleBlock)
+	{
+		this->simpleBlock = simpleBlock;
+		dataSize = blockSize;
+		headerOnly = true;
+		frames.clear();
+
+		size_t index = ParseFixedHeader(data, length);
+		if (GetLacing() == Lacing::None)
+			frameCount = 1;
+		else if (index < length)
+			frameCount = (size_t) data[index++] + 1;
+		else
+			throw std::runtime_error("EBMLBlock::ParseHeader(). Laced block has no frame count.");
+		headerLength = index;
+	}
+
+	uint64_t EBMLBlock::GetTrackNumber() const { return trackNumber; }
+	int16_t EBMLBlock::GetTimecode() const { return timecode; }
+	uint8_t EBMLBlock::GetFlags() const { return flags; }
+	bool EBMLBlock::IsSimpleBlock() const { return simpleBlock; }
+	bool EBMLBlock::IsKeyframe() const { return simpleBlock && (flags & 0x80); }
+	bool EBMLBlock::IsInvisible() const { return flags & 0x08; }
+	bool EBMLBlock::IsDiscardable() const { return simpleBlock && (flags & 0x01); }
+	EBMLBlock::Lacing EBMLBlock::GetLacing() const { return (Lacing) ((flags >> 1) & 0x03); }
+	size_t EBMLBlock::GetHeaderLength() const { return headerLength; }
+	size_t EBMLBlock::GetDataSize() const { return dataSize; }
+	bool EBMLBlock::IsHeaderOnly() const { return headerOnly; }
+	size_t EBMLBlock::GetFrameCount() const { return frameCount; }
+	const std::vector<EBMLBlock::Frame> & EBMLBlock::Frames() const { return frames; }
+
+	const EBMLBlock::Frame & EBMLBlock::GetFrame(size_t index) const
+	{
+		if (index >= frames.size())
+			throw std::out_of_range("EBMLBlock::GetFrame(). Frame " + std::to_string(index) + " is out of range.");
+		return frames[index];
+	}
+}
\ No newline at end of file
@@ -0,0 +1,88 @@
+#include <EBMLTools/EBMLChildRange.hpp>
+#include <EBMLTools/EBMLReader.hpp>
+
+#include <stdexcept>
+
+namespace EBMLTools
+{
+	EBMLChildRange::iterator::iterator(std::shared_ptr<const EBMLReadElement> parent, uint64_t filter, size_t start, size_t end)
+		: parent(parent), filter(filter), next(start), end(end)
+	{
+		Advance();
+	}
+
+	EBMLChildRange::iterator::iterator(const iterator & rhs) { *this = rhs; }
+
+	EBMLChildRange::iterator & EBMLChildRange::iterator::operator= (const iterator & rhs)
+	{
+		parent = rhs.parent;
+		filter = rhs.filter;
+		next = rhs.next;
+		end = rhs.end;
+		current.reset(rhs.current ? new EBMLReadElement(*rhs.current) : NULL);
+		return *this;
+	}
+
+	void EBMLChildRange::iterator::Advance()
+	{
+		current.reset();
+		EBMLReader * reader = parent->reader;
+		size_t cachedPosition = reader->GetReadPosition();
+		reader->SetReadPosition(next);
+		while (reader->GetReadPosition() < end)
+		{
+			EBMLReadElement element = reader->ReadElement(*parent);
+			if (filter == 0 || element.GetElementId() == filter)
+			{
+				current.reset(new EBMLReadElement(element));
+				break;
+			}
+		}
+		next = reader->GetReadPosition();
+		reader->SetReadPosition(cachedPosition);
+	}
+
+	const EBMLReadElement & EBMLChildRange::iterator::operator*() const
+	{
+		if (!current)
+			throw std::out_of_range("EBMLChildRange::iterator, cannot dereference the end of the range.");
+		return *current;
+	}
+
+	const EBMLReadElement * EBMLChildRange::iterator::operator->() const { return &**this; }
+
+	EBMLChildRange::iterator & EBMLChildRange::iterator::operator++()
+	{
+		Advance();
+		return *this;
+	}
+
+	bool EBMLChildRange::iterator::operator ==(const iterator & rhs) const
+	{
+		if (!current || !rhs.current)
+			return !current && !rhs.current;
+		return current->GetElementPosition() == rhs.current->GetElementPosition();
+	}
+
+	bool EBMLChildRange::iterator::operator !=(const iterator & rhs) const { return !(*this == rhs); }
+
+	EBMLChildRange::EBMLChildRange(const EBMLReadElement & parent) : parent(std::make_shared<const EBMLReadElement>(parent))
+	{
+		if (parent.GetElementType() != Master)
+			throw std::runtime_error("EBMLChildRange::EBMLChildRange(), element is not of Type Master.. Element: " + parent.GetElementName());
+	}
+
+	EBMLChildRange::EBMLChildRange(const EBMLReadElement & parent, const EBMLElement & filter) : EBMLChildRange(parent)
+	{
+		if (filter != parent)
+			this->filter = filter.GetElementId();
+	}
+
+	EBMLChildRange::iterator EBMLChildRange::begin() const
+	{
+		size_t start = parent->GetElementPosition() + parent->GetElementIdByteLength() + parent->GetElementDataSizeByteLength();
+		return iterator(parent, filter, start, parent->GetElementPosition() + parent->GetElementByteLength());
+	}
+
+	EBMLChildRange::iterator EBMLChildRange::end() const { return iterator(); }
+}
\ No newline at end of file
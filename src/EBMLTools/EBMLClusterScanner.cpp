@@ -0,0 +1,204 @@
+#include <EBMLTools/EBMLClusterScanner.hpp>
+#include <EBMLTools/EBMLFileWindow.hpp>
+#include <EBMLTools/EBMLPatternScanner.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace EBMLTools
+{
+	namespace
+	{
+		const uint64_t SEGMENT_ID = 0x18538067;
+		const uint64_t CLUSTER_ID = 0x1F43B675;
+		const uint64_t TIMECODE_ID = 0xE7;
+		const uint64_t CRC32_ID = 0xBF;
+		const uint64_t SIMPLEBLOCK_ID = 0xA3;
+		const uint64_t BLOCKGROUP_ID = 0xA0;
+		const uint64_t BLOCK_ID = 0xA1;
+		const uint64_t REFERENCEBLOCK_ID = 0xFB;
+
+		bool IsLevel1Id(uint64_t id)
+		{
+			try
+			{
+				const EBMLElement & element = EBMLElement::Find(id);
+				return element.GetElementParentId() == SEGMENT_ID || element.isGlobalElement();
+			}
+			catch (std::invalid_argument &)
+			{
+				return false;
+			}
+		}
+	}
+
+	EBMLClusterScanner::EBMLClusterScanner(EBMLReader & reader) : fileName(reader.GetFilename())
+	{
+		EBMLReadElement segment = reader.GetRootElements(EBMLElement::Find("Segment")).at(0);
+		segmentDataPosition = reader.GetSegmentDataPosition();
+		segmentEnd = segment.GetElementPosition() + segment.GetElementByteLength();
+		fd = open(fileName.c_str(), O_RDONLY);
+		if (fd < 0)
+			throw std::runtime_error("EBMLClusterScanner::EBMLClusterScanner(). The file: " + fileName + " is inaccessable");
+	}
+
+	EBMLClusterScanner::~EBMLClusterScanner() { if (fd >= 0) close(fd); }
+
+	void EBMLClusterScanner::SetWindowSize(size_t bytes) { windowSize = std::max<size_t>(bytes, 4096); }
+	void EBMLClusterScanner::SetMinimumRangeSize(size_t bytes) { minimumRangeSize = std::max<size_t>(bytes, 1); }
+
+	std::vector<EBMLClusterScanner::Range> EBMLClusterScanner::Split(size_t threads) const
+	{
+		if (threads == 0)
+			threads = std::max(1u, std::thread::hardware_concurrency());
+		size_t total = segmentEnd - segmentDataPosition;
+		size_t count = std::max<size_t>(1, std::min(threads, total / minimumRangeSize));
+		std::vector<Range> ranges;
+		for (size_t i = 0; i < count; i++)
+		{
+			size_t start = segmentDataPosition + total / count * i;
+			size_t end = i + 1 == count ? segmentEnd : segmentDataPosition + total / count * (i + 1);
+			ranges.push_back(Range { start, end, NotFound, NotFound });
+		}
+		return ranges;
+	}
+
+	size_t EBMLClusterScanner::Resync(size_t from, size_t end) const
+	{
+		const size_t patternLength = 4;
+		EBMLPatternScanner scanner({ CLUSTER_ID });
+		EBMLFileWindow window(fd, windowSize), probe(fd, 64 * 1024);
+		size_t position = from;
+		while (position < end)
+		{
+			size_t available, index;
+			const uint8_t * data = window.Get(position, patternLength, available);
+			if (available < patternLength)
+				return NotFound;
+			size_t searchLength = std::min(available, end - position + patternLength - 1);
+			for (size_t offset = 0, match; (match = scanner.Find(data + offset, searchLength - offset, index)) != EBMLPatternScanner::NotFound; )
+			{
+				// Plausible size, Timecode as the first child (after an optional CRC-32), and a level 1 ID (or the segment end) behind it
+				size_t candidate = position + offset + match;
+				offset += match + 1;
+				size_t length;
+				const uint8_t * bytes = probe.Get(candidate, 32, length);
+				EBMLFileWindow::Header cluster, child;
+				if (!EBMLFileWindow::ParseHeader(bytes, length, cluster) || (!cluster.unknownSize && candidate + cluster.headerLength + cluster.dataSize > segmentEnd))
+					continue;
+				if (!EBMLFileWindow::ParseHeader(bytes + cluster.headerLength, length - cluster.headerLength, child))
+					continue;
+				if (child.id == CRC32_ID)
+				{
+					size_t timecode = cluster.headerLength + child.headerLength + child.dataSize;
+					if (timecode >= length || !EBMLFileWindow::ParseHeader(bytes + timecode, length - timecode, child))
+						continue;
+				}
+				if (child.id != TIMECODE_ID || child.dataSize > 8)
+					continue;
+				if (cluster.unknownSize) // Live recording, there is no end to check
+					return candidate;
+				size_t next = candidate + cluster.headerLength + cluster.dataSize;
+				if (next == segmentEnd)
+					return candidate;
+				bytes = probe.Get(next, 12, length);
+				EBMLFileWindow::Header sibling;
+				if (EBMLFileWindow::ParseHeader(bytes, length, sibling) && IsLevel1Id(sibling.id))
+					return candidate;
+			}
+			position += available - (patternLength - 1); // Overlap so an ID across the window edge is found
+		}
+		return NotFound;
+	}
+
+	void EBMLClusterScanner::ScanRange(Range & range, bool exactStart, const std::function<void(const Cluster &)> & visit) const
+	{
+		size_t position = exactStart ? range.start : Resync(range.start, range.end);
+		range.first = position;
+		if (position == NotFound)
+			return;
+
+		EBMLFileWindow window(fd, windowSize);
+		Cluster cluster;
+		size_t available;
+		while (position < range.end && position < segmentEnd)
+		{
+			EBMLFileWindow::Header header;
+			const uint8_t * data = window.Get(position, 12, available);
+			if (!EBMLFileWindow::ParseHeader(data, available, header))
+				throw std::runtime_error("EBMLClusterScanner::ScanRange(). Invalid level 1 element at " + std::to_string(position));
+			if (header.unknownSize)
+				header.dataSize = window.FindUnknownSizeEnd(header.id, position + header.headerLength, segmentEnd) - position - header.headerLength;
+			size_t next = position + header.headerLength + header.dataSize;
+			if (header.id == CLUSTER_ID)
+			{
+				cluster.position = position;
+				cluster.dataPosition = position + header.headerLength;
+				cluster.size = next - position;
+				cluster.timecode = 0;
+				cluster.blocks.clear();
+				for (size_t childPosition = position + header.headerLength; childPosition < next; )
+				{
+					EBMLFileWindow::Header child;
+					data = window.Get(childPosition, 12, available);
+					if (!EBMLFileWindow::ParseHeader(data, available, child))
+						throw std::runtime_error("EBMLClusterScanner::ScanRange(). Invalid element at " + std::to_string(childPosition));
+					size_t childData = childPosition + child.headerLength;
+					if (child.unknownSize)
+						child.dataSize = window.FindUnknownSizeEnd(child.id, childData, next) - childData;
+					if (child.id == TIMECODE_ID)
+					{
+						data = window.Get(childData, child.dataSize, available);
+						for (size_t i = 0; i < child.dataSize && i < available; i++)
+							cluster.timecode = (cluster.timecode << 8) | data[i];
+					}
+					else if (child.id == SIMPLEBLOCK_ID || child.id == BLOCKGROUP_ID)
+					{
+						BlockHeader block { childPosition, child.headerLength + child.dataSize, EBMLBlock(), false };
+						bool found = false, referenced = false;
+						size_t blockData = childData, blockSize = child.dataSize;
+						if (child.id == BLOCKGROUP_ID)
+						{
+							for (size_t groupPosition = childData; groupPosition < childData + child.dataSize; )
+							{
+								EBMLFileWindow::Header groupChild;
+								data = window.Get(groupPosition, 12, available);
+								if (!EBMLFileWindow::ParseHeader(data, available, groupChild) || groupChild.unknownSize)
+									break;
+								if (groupChild.id == BLOCK_ID)
+								{
+									found = true;
+									blockData = groupPosition + groupChild.headerLength;
+									blockSize = groupChild.dataSize;
+								}
+								else if (groupChild.id == REFERENCEBLOCK_ID)
+									referenced = true;
+								groupPosition += groupChild.headerLength + groupChild.dataSize;
+							}
+						}
+						else
+							found = true;
+						if (found)
+						{
+							data = window.Get(blockData, std::min<size_t>(blockSize, (size_t) EBMLBlock::MaxHeaderLength), available);
+							try
+							{
+								block.block.ParseHeader(data, std::min(available, blockSize), blockSize, child.id == SIMPLEBLOCK_ID);
+								block.keyframe = child.id == SIMPLEBLOCK_ID ? block.block.IsKeyframe() : !referenced;
+								cluster.blocks.push_back(block);
+							}
+							catch (std::runtime_error &) {} // Damaged block headers are left out
+						}
+					}
+					childPosition = childData + child.dataSize;
+				}
+				visit(cluster);
+			}
+			position = next;
+		}
+		range.next = position;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,226 @@
+#include <EBMLTools/EBMLCueIndex.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace EBMLTools
+{
+	namespace
+	{
+		// Collects CueTrackPositions in one pass over the Cues element
+		class CueVisitor : public EBMLVisitor
+		{
+			private:
+				std::vector<EBMLCueIndex::CueEntry> & entries;
+				const uint64_t cueTimeId = EBMLElement::Find("CueTime").GetElementId();
+				const uint64_t cueTrackPositionsId = EBMLElement::Find("CueTrackPositions").GetElementId();
+				const uint64_t cueTrackId = EBMLElement::Find("CueTrack").GetElementId();
+				const uint64_t cueClusterPositionId = EBMLElement::Find("CueClusterPosition").GetElementId();
+				const uint64_t cueRelativePositionId = EBMLElement::Find("CueRelativePosition").GetElementId();
+				const uint64_t cueReferenceId = EBMLElement::Find("CueReference").GetElementId();
+				uint64_t time = 0, track = 0, clusterPosition = 0, relativePosition = 0;
+			public:
+				CueVisitor(std::vector<EBMLCueIndex::CueEntry> & entries) : entries(entries) {}
+				VisitResult EnterMaster(const EBMLReadElement & element)
+				{
+					if (element.GetElementId() == cueReferenceId)
+						return VisitResult::SkipChildren;
+					if (element.GetElementId() == cueTrackPositionsId)
+						track = clusterPosition = relativePosition = 0;
+					return VisitResult::Continue;
+				}
+				VisitResult Element(const EBMLReadElement & element)
+				{
+					uint64_t id = element.GetElementId();
+					if (id == cueTimeId)
+						time = element.GetUintData();
+					else if (id == cueTrackId)
+						track = element.GetUintData();
+					else if (id == cueClusterPositionId)
+						clusterPosition = element.GetUintData();
+					else if (id == cueRelativePositionId)
+						relativePosition = element.GetUintData();
+					return VisitResult::Continue;
+				}
+				VisitResult ExitMaster(const EBMLReadElement & element)
+				{
+					if (element.GetElementId() == cueTrackPositionsId)
+						entries.push_back(EBMLCueIndex::CueEntry { track, time, clusterPosition, relativePosition });
+					return VisitResult::Continue;
+				}
+		};
+	}
+
+	// PRIVATE STATIC
+	void EBMLCueIndex::Append(TrackCues & cues, uint64_t time, uint64_t clusterPosition, uint64_t relativePosition)
+	{
+		const uint64_t maxDelta = std::numeric_limits<uint32_t>::max();
+		size_t index = cues.timeDelta.size();
+		if (cues.blockStart.empty() || index - cues.blockStart.back() >= AnchorInterval
+			|| time - cues.blockTime.back() > maxDelta
+			|| clusterPosition < cues.blockCluster.back() || clusterPosition - cues.blockCluster.back() > maxDelta)
+		{
+			cues.blockStart.push_back(index);
+			cues.blockTime.push_back(time);
+			cues.blockCluster.push_back(clusterPosition);
+		}
+		cues.timeDelta.push_back(time - cues.blockTime.back());
+		cues.clusterDelta.push_back(clusterPosition - cues.blockCluster.back());
+		cues.relativePosition.push_back(relativePosition > maxDelta ? 0 : relativePosition);
+	}
+
+	size_t EBMLCueIndex::BlockOf(const TrackCues & cues, size_t index)
+	{
+		return std::upper_bound(cues.blockStart.begin(), cues.blockStart.end(), index) - cues.blockStart.begin() - 1;
+	}
+
+	EBMLCueIndex::CueEntry EBMLCueIndex::Decode(uint64_t track, const TrackCues & cues, size_t index)
+	{
+		size_t block = BlockOf(cues, index);
+		return CueEntry { track, cues.blockTime[block] + cues.timeDelta[index], cues.blockCluster[block] + cues.clusterDelta[index], cues.relativePosition[index] };
+	}
+
+	// PUBLIC
+	EBMLCueIndex::EBMLCueIndex() {}
+	EBMLCueIndex::EBMLCueIndex(EBMLReader & reader) { Load(reader); }
+
+	void EBMLCueIndex::Load(EBMLReader & reader)
+	{
+		auto cues = reader.FastSearch(EBMLElement::Find("Cues"));
+		if (cues.size() == 0)
+			throw std::out_of_range("EBMLCueIndex::Load(). " + reader.GetFilename() + " has no Cues element.");
+		Clear();
+		segmentDataPosition = reader.GetSegmentDataPosition();
+		std::vector<CueEntry> entries;
+		CueVisitor visitor(entries);
+		reader.Walk(cues.at(0), visitor);
+
+		// Muxers do not have to write CuePoints in time order, encode each track sorted
+		std::stable_sort(entries.begin(), entries.end(), [](const CueEntry & a, const CueEntry & b) { return a.track < b.track || (a.track == b.track && a.time < b.time); });
+		for (auto & entry : entries)
+			Append(tracks[entry.track], entry.time, entry.clusterPosition, entry.relativePosition);
+		size = entries.size();
+	}
+
+	void EBMLCueIndex::Clear()
+	{
+		tracks.clear();
+		size = 0;
+	}
+
+	void EBMLCueIndex::Add(uint64_t track, uint64_t time, uint64_t clusterPosition, uint64_t relativePosition)
+	{
+		TrackCues & cues = tracks[track];
+		size++;
+		if (cues.timeDelta.empty() || Decode(track, cues, cues.timeDelta.size() - 1).time <= time)
+		{
+			Append(cues, time, clusterPosition, relativePosition);
+			return;
+		}
+		// Out of order, re-encode the track with the new entry in place
+		std::vector<CueEntry> entries = Entries(track);
+		auto it = std::upper_bound(entries.begin(), entries.end(), time, [](uint64_t t, const CueEntry & e) { return t < e.time; });
+		entries.insert(it, CueEntry { track, time, clusterPosition, relativePosition });
+		cues = TrackCues();
+		for (auto & entry : entries)
+			Append(cues, entry.time, entry.clusterPosition, entry.relativePosition);
+	}
+
+	size_t EBMLCueIndex::Size() const { return size; }
+
+	std::vector<uint64_t> EBMLCueIndex::GetTracks() const
+	{
+		std::vector<uint64_t> results;
+		for (auto & track : tracks)
+			results.push_back(track.first);
+		return results;
+	}
+
+	std::vector<EBMLCueIndex::CueEntry> EBMLCueIndex::Entries(uint64_t track) const
+	{
+		std::vector<CueEntry> results;
+		auto it = tracks.find(track);
+		if (it == tracks.end())
+			return results;
+		const TrackCues & cues = it->second;
+		results.reserve(cues.timeDelta.size());
+		for (size_t block = 0; block < cues.blockStart.size(); block++)
+		{
+			size_t end = block + 1 < cues.blockStart.size() ? cues.blockStart[block + 1] : cues.timeDelta.size();
+			for (size_t i = cues.blockStart[block]; i < end; i++)
+				results.push_back(CueEntry { track, cues.blockTime[block] + cues.timeDelta[i], cues.blockCluster[block] + cues.clusterDelta[i], cues.relativePosition[i] });
+		}
+		return results;
+	}
+
+	void EBMLCueIndex::SetSegmentDataPosition(size_t position) { segmentDataPosition = position; }
+	size_t EBMLCueIndex::GetSegmentDataPosition() const { return segmentDataPosition; }
+
+	EBMLCueIndex::CueEntry EBMLCueIndex::FindCue(uint64_t track, uint64_t time) const
+	{
+		auto it = tracks.find(track);
+		if (it == tracks.end() || it->second.timeDelta.empty())
+			throw std::out_of_range("EBMLCueIndex::FindCue(). No cues for track " + std::to_string(track));
+		const TrackCues & cues = it->second;
+
+		size_t block = std::upper_bound(cues.blockTime.begin(), cues.blockTime.end(), time) - cues.blockTime.begin();
+		if (block == 0)
+			return Decode(track, cues, 0);
+		block--;
+
+		size_t start = cues.blockStart[block];
+		size_t end = block + 1 < cues.blockStart.size() ? cues.blockStart[block + 1] : cues.timeDelta.size();
+		uint32_t delta = (uint32_t) std::min<uint64_t>(time - cues.blockTime[block], std::numeric_limits<uint32_t>::max());
+		size_t index = std::upper_bound(cues.timeDelta.begin() + start, cues.timeDelta.begin() + end, delta) - cues.timeDelta.begin() - 1;
+		return Decode(track, cues, index);
+	}
+
+	size_t EBMLCueIndex::SeekToTime(uint64_t track, uint64_t time) const
+	{
+		return segmentDataPosition + FindCue(track, time).clusterPosition;
+	}
+
+	EBMLWriteElement EBMLCueIndex::CreateCuesElement() const
+	{
+		std::vector<CueEntry> entries;
+		entries.reserve(size);
+		for (auto & track : tracks)
+		{
+			auto trackEntries = Entries(track.first);
+			entries.insert(entries.end(), trackEntries.begin(), trackEntries.end());
+		}
+		std::stable_sort(entries.begin(), entries.end(), [](const CueEntry & a, const CueEntry & b) { return a.time < b.time; });
+
+		EBMLWriteElement cues(EBMLElement::Find("Cues"));
+		EBMLWriteElement * cuePoint = NULL;
+		for (size_t i = 0; i < entries.size(); i++)
+		{
+			if (i == 0 || entries[i].time != entries[i - 1].time)
+			{
+				auto newCuePoint = std::make_unique<EBMLWriteElement>(EBMLElement::Find("CuePoint"));
+				auto cueTime = std::make_unique<EBMLWriteElement>(EBMLElement::Find("CueTime"));
+				cueTime->SetUintData(entries[i].time);
+				newCuePoint->Children().push_back(std::move(cueTime));
+				cuePoint = newCuePoint.get();
+				cues.Children().push_back(std::move(newCuePoint));
+			}
+			auto cueTrackPositions = std::make_unique<EBMLWriteElement>(EBMLElement::Find("CueTrackPositions"));
+			auto cueTrack = std::make_unique<EBMLWriteElement>(EBMLElement::Find("CueTrack"));
+			auto cueClusterPosition = std::make_unique<EBMLWriteElement>(EBMLElement::Find("CueClusterPosition"));
+			cueTrack->SetUintData(entries[i].track);
+			cueClusterPosition->SetUintData(entries[i].clusterPosition);
+			cueTrackPositions->Children().push_back(std::move(cueTrack));
+			cueTrackPositions->Children().push_back(std::move(cueClusterPosition));
+			if (entries[i].relativePosition != 0)
+			{
+				auto cueRelativePosition = std::make_unique<EBMLWriteElement>(EBMLElement::Find("CueRelativePosition"));
+				cueRelativePosition->SetUintData(entries[i].relativePosition);
+				cueTrackPositions->Children().push_back(std::move(cueRelativePosition));
+			}
+			cuePoint->Children().push_back(std::move(cueTrackPositions));
+		}
+		cues.Validate();
+		return cues;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,285 @@
+#include <EBMLTools/EBMLDurationEstimator.hpp>
+#include <EBMLTools/EBMLFileWindow.hpp>
+#include <EBMLTools/EBMLPatternScanner.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace EBMLTools
+{
+	namespace
+	{
+		const uint64_t SEGMENT_ID = 0x18538067;
+		const uint64_t CLUSTER_ID = 0x1F43B675;
+		const uint64_t CUES_ID = 0x1C53BB6B;
+		const uint64_t CUEPOINT_ID = 0xBB;
+		const uint64_t CUETRACKPOSITIONS_ID = 0xB7;
+		const uint64_t CUECLUSTERPOSITION_ID = 0xF1;
+		const uint64_t TIMECODE_ID = 0xE7;
+		const uint64_t CRC32_ID = 0xBF;
+		const size_t NotFound = (size_t) -1;
+
+		// Largest CueClusterPosition of the CuePoint data in memory, NotFound unless all of it parses as children
+		size_t LastClusterPosition(const uint8_t * data, size_t length)
+		{
+			size_t last = NotFound;
+			EBMLFileWindow::Header child, position;
+			for (size_t index = 0; index < length; index += child.headerLength + child.dataSize)
+			{
+				if (!EBMLFileWindow::ParseHeader(data + index, length - index, child) || child.unknownSize || child.dataSize > length - index - child.headerLength)
+					return NotFound;
+				if (child.id != CUETRACKPOSITIONS_ID)
+					continue;
+				const uint8_t * positions = data + index + child.headerLength;
+				for (size_t offset = 0; offset < child.dataSize; offset += position.headerLength + position.dataSize)
+				{
+					if (!EBMLFileWindow::ParseHeader(positions + offset, child.dataSize - offset, position) || position.unknownSize || position.dataSize > child.dataSize - offset - position.headerLength)
+						return NotFound;
+					if (position.id != CUECLUSTERPOSITION_ID || position.dataSize > 8)
+						continue;
+					uint64_t value = 0;
+					for (size_t i = 0; i < position.dataSize; i++)
+						value = (value << 8) | positions[offset + position.headerLength + i];
+					if (last == NotFound || value > last)
+						last = value;
+				}
+			}
+			return last;
+		}
+	}
+
+	EBMLDurationEstimator::EBMLDurationEstimator(EBMLReader & reader) : reader(reader)
+	{
+		EBMLReadElement segment = reader.GetRootElements(EBMLElement::Find("Segment")).at(0);
+		segmentEnd = segment.GetElementPosition() + segment.GetElementByteLength();
+	}
+
+	void EBMLDurationEstimator::SetTailWindow(size_t bytes) { tailWindow = std::max<size_t>(bytes, 4096); }
+
+	size_t EBMLDurationEstimator::FromCues()
+	{
+		// Only a Cues element listed in the SeekHead, finding it otherwise means reading every level 1 header
+		auto seek = std::find_if(reader.seekHead.begin(), reader.seekHead.end(), [](const std::pair<const size_t, uint64_t> & entry) { return entry.second == CUES_ID; });
+		if (seek == reader.seekHead.end())
+			return NotFound;
+		uint8_t bytes[12];
+		EBMLFileWindow::Header cues;
+		if (!EBMLFileWindow::ParseHeader(bytes, reader.ReadRaw(seek->first, bytes, sizeof(bytes)), cues) || cues.id != CUES_ID || cues.unknownSize)
+			return NotFound;
+
+		// The last CuePoint ends where the Cues end: a growing tail of them is searched backwards for a CuePoint
+		// header whose element reaches exactly that far and parses, instead of walking every CuePoint before it
+		size_t dataPosition = seek->first + cues.headerLength;
+		size_t end = dataPosition + cues.dataSize;
+		std::vector<uint8_t> buffer;
+		for (size_t window = 4096; ; window *= 2)
+		{
+			size_t start = end - std::min<size_t>(window, end - dataPosition);
+			buffer.resize(end - start);
+			if (reader.ReadRaw(start, buffer.data(), buffer.size()) != buffer.size())
+				return NotFound; // Cut off Cues
+			for (size_t offset = buffer.size(); offset-- > 0;)
+			{
+				EBMLFileWindow::Header point;
+				if (buffer[offset] != CUEPOINT_ID || !EBMLFileWindow::ParseHeader(buffer.data() + offset, buffer.size() - offset, point) || point.id != CUEPOINT_ID)
+					continue;
+				if (point.unknownSize || offset + point.headerLength + point.dataSize != buffer.size())
+					continue;
+				size_t last = LastClusterPosition(buffer.data() + offset + point.headerLength, point.dataSize);
+				if (last != NotFound)
+					return reader.GetSegmentDataPosition() + last;
+			}
+			if (start == dataPosition)
+				return NotFound;
+		}
+	}
+
+	size_t EBMLDurationEstimator::FromSeekHead()
+	{
+		size_t last = NotFound;
+		for (auto & seek : reader.seekHead)
+			if (seek.second == CLUSTER_ID)
+				last = seek.first; // Ordered by position
+		return last;
+	}
+
+	bool EBMLDurationEstimator::IsCluster(size_t position)
+	{
+		// Same checks as the resync of EBMLClusterScanner: a size that fits in the segment, Timecode as
+		// the first child (after an optional CRC-32) and a level 1 ID, the segment end or the file end behind it
+		uint8_t bytes[32];
+		size_t length = reader.ReadRaw(position, bytes, sizeof(bytes));
+		EBMLFileWindow::Header cluster, child;
+		if (!EBMLFileWindow::ParseHeader(bytes, length, cluster) || cluster.id != CLUSTER_ID)
+			return false;
+		if (!cluster.unknownSize && position + cluster.headerLength + cluster.dataSize > segmentEnd)
+			return false;
+		if (!EBMLFileWindow::ParseHeader(bytes + cluster.headerLength, length - cluster.headerLength, child))
+			return false;
+		if (child.id == CRC32_ID)
+		{
+			size_t timecode = cluster.headerLength + child.headerLength + child.dataSize;
+			if (timecode >= length || !EBMLFileWindow::ParseHeader(bytes + timecode, length - timecode, child))
+				return false;
+		}
+		if (child.id != TIMECODE_ID || child.dataSize > 8)
+			return false;
+		size_t next = position + cluster.headerLength + cluster.dataSize;
+		if (cluster.unknownSize || next >= segmentEnd || next >= reader.fileSize)
+			return true;
+		EBMLFileWindow::Header sibling;
+		length = reader.ReadRaw(next, bytes, 12);
+		if (!EBMLFileWindow::ParseHeader(bytes, length, sibling))
+			return false;
+		try
+		{
+			const EBMLElement & element = EBMLElement::Find(sibling.id);
+			return element.GetElementParentId() == SEGMENT_ID || element.isGlobalElement();
+		}
+		catch (std::invalid_argument &)
+		{
+			return false;
+		}
+	}
+
+	size_t EBMLDurationEstimator::FromTail()
+	{
+		const size_t patternLength = 4;
+		EBMLPatternScanner scanner({ CLUSTER_ID });
+		size_t dataPosition = reader.GetSegmentDataPosition();
+		size_t end = std::min(segmentEnd, reader.fileSize);
+		size_t window = tailWindow;
+		std::vector<uint8_t> buffer;
+		while (end > dataPosition)
+		{
+			// Every window reaches back as far as the ones before it together, the covered tail doubles
+			size_t start = end - std::min(window, end - dataPosition);
+			buffer.resize(end - start);
+			buffer.resize(reader.ReadRaw(start, buffer.data(), buffer.size()));
+
+			std::vector<size_t> matches;
+			size_t index;
+			for (size_t offset = 0, match; offset + patternLength <= buffer.size() && (match = scanner.Find(buffer.data() + offset, buffer.size() - offset, index)) != EBMLPatternScanner::NotFound; offset += match + 1)
+				matches.push_back(start + offset + match);
+			for (auto match = matches.rbegin(); match != matches.rend(); match++)
+				if (IsCluster(*match))
+					return *match;
+
+			if (start == dataPosition)
+				break;
+			window = std::min(segmentEnd, reader.fileSize) - start;
+			end = start + patternLength - 1; // Overlap so an ID across the window edge is found
+		}
+		return NotFound;
+	}
+
+	size_t EBMLDurationEstimator::ClustersEnd(size_t position)
+	{
+		// The first level 1 element behind position that the SeekHead lists and is not a Cluster, ordered by position
+		for (auto seek = reader.seekHead.upper_bound(position); seek != reader.seekHead.end(); seek++)
+			if (seek->second != CLUSTER_ID)
+				return std::min(seek->first, std::min(segmentEnd, reader.fileSize));
+		return std::min(segmentEnd, reader.fileSize);
+	}
+
+	size_t EBMLDurationEstimator::FollowToLast(size_t position)
+	{
+		// Clusters after the last cue point (or SeekHead entry), only the level 1 headers are read
+		size_t last = position;
+		size_t end = std::min(segmentEnd, reader.fileSize);
+		try
+		{
+			while (position < end)
+			{
+				EBMLReadElement element = reader.GetElement(position);
+				if (element.GetElementId() == CLUSTER_ID)
+					last = position;
+				position += element.GetElementByteLength();
+			}
+		}
+		catch (std::exception &)
+		{
+			reader.fileStream.clear(); // Damaged or cut off, the last Cluster read stands
+		}
+		return last;
+	}
+
+	size_t EBMLDurationEstimator::FindLastCluster(Source & source)
+	{
+		size_t cues = NotFound;
+		try
+		{
+			cues = FromCues();
+		}
+		catch (std::exception &)
+		{
+			reader.fileStream.clear(); // Damaged Cues, the other sources are tried
+		}
+		size_t seekHead = FromSeekHead();
+		// Following a Cluster forward reads the header of every level 1 element behind it, so Cues and SeekHead
+		// are only taken when they point into the tail window of the Clusters; a live cut often lists only the first Cluster
+		if (cues != NotFound && (cues + tailWindow < ClustersEnd(cues) || !IsCluster(cues)))
+			cues = NotFound;
+		if (seekHead != NotFound && (seekHead + tailWindow < ClustersEnd(seekHead) || !IsCluster(seekHead)))
+			seekHead = NotFound;
+
+		size_t position;
+		if (cues != NotFound && (seekHead == NotFound || cues >= seekHead))
+		{
+			position = cues;
+			source = Source::Cues;
+		}
+		else if (seekHead != NotFound)
+		{
+			position = seekHead;
+			source = Source::SeekHead;
+		}
+		else
+		{
+			position = FromTail();
+			source = Source::TailScan;
+		}
+		if (position == NotFound)
+			throw std::runtime_error("EBMLDurationEstimator::FindLastCluster(). No Cluster was found in " + reader.GetFilename());
+		return FollowToLast(position);
+	}
+
+	EBMLDurationEstimator::Estimate EBMLDurationEstimator::Compute()
+	{
+		Estimate result;
+		result.clusterPosition = FindLastCluster(result.source);
+		result.timecode = 0;
+		int64_t lastBlock = std::numeric_limits<int64_t>::min();
+
+		auto consider = [&](const EBMLReadElement & block) {
+			try
+			{
+				lastBlock = std::max<int64_t>(lastBlock, reader.ReadBlockHeader(block).GetTimecode());
+			}
+			catch (std::runtime_error &) {} // Damaged block headers are left out
+		};
+		try
+		{
+			EBMLReadElement cluster = reader.GetElement(result.clusterPosition);
+			for (auto & child : cluster.ChildRange())
+			{
+				if (child.GetElementId() == TIMECODE_ID)
+					result.timecode = child.GetUintData();
+				else if (child.GetElementName() == "SimpleBlock")
+					consider(child);
+				else if (child.GetElementName() == "BlockGroup")
+					for (auto & block : child.ChildRange(EBMLElement::Find("Block")))
+						consider(block);
+			}
+		}
+		catch (std::exception &)
+		{
+			reader.fileStream.clear(); // A Cluster cut off by the end of the file keeps the blocks before the cut
+		}
+
+		result.lastBlock = lastBlock == std::numeric_limits<int64_t>::min() ? 0 : lastBlock;
+		result.duration = (double) ((int64_t) result.timecode + result.lastBlock);
+		return result;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,259 @@
+#include <EBMLTools/EBMLExtractor.hpp>
+#include <EBMLTools/EBMLClusterScanner.hpp>
+#include <EBMLTools/EBMLCueIndex.hpp>
+#include <EBMLTools/EBMLFileUtilities.hpp>
+#include <EBMLTools/EBMLFileWindow.hpp>
+#include <EBMLTools/EBMLParser.hpp>
+#include <EBMLTools/EBMLTypedElements.hpp>
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace EBMLTools
+{
+	namespace
+	{
+		// A level 1 element of the output, either generated or copied unchanged from the source
+		struct Part
+		{
+			uint64_t id;
+			std::unique_ptr<EBMLWriteElement> element;
+			size_t source;
+			size_t length;
+		};
+
+		// Cluster header, Timecode and the untouched rest of the source Cluster behind them
+		struct ClusterPlan
+		{
+			uint8_t header[12];
+			size_t headerLength;
+			std::unique_ptr<EBMLWriteElement> timecode;
+			size_t rest;
+			size_t restLength;
+			size_t Length() const { return headerLength + timecode->GetElementByteLength() + restLength; }
+		};
+	}
+
+	EBMLExtractor::EBMLExtractor(EBMLReader & reader) : reader(reader) {}
+
+	void EBMLExtractor::SetRebase(bool rebase) { this->rebase = rebase; }
+	void EBMLExtractor::SetThreads(size_t threads) { this->threads = threads; }
+
+	EBMLExtractor::Result EBMLExtractor::Extract(const std::string & output, uint64_t start, uint64_t end)
+	{
+		auto infos = reader.FastSearch(EBMLElement::Find("Info"));
+		auto tracks = reader.FastSearch(EBMLElement::Find("Tracks"));
+		if (infos.size() == 0 || tracks.size() == 0)
+			throw std::runtime_error("EBMLExtractor::Extract(). " + reader.GetFilename() + " has no Info or Tracks element.");
+		uint64_t timecodeScale = SegmentInfo::Decode(infos.at(0)).timecodeScale;
+
+		// Clusters starting before the end of the range, in file order
+		EBMLClusterScanner scanner(reader);
+		auto partials = scanner.Scan<std::vector<EBMLClusterScanner::Cluster>>([&](std::vector<EBMLClusterScanner::Cluster> & clusters, const EBMLClusterScanner::Cluster & cluster) {
+			if (cluster.timecode * timecodeScale < end)
+				clusters.push_back(cluster);
+		}, threads);
+		std::vector<EBMLClusterScanner::Cluster> clusters;
+		for (auto & partial : partials)
+			clusters.insert(clusters.end(), partial.begin(), partial.end());
+		size_t first = 0;
+		for (size_t i = 0; i < clusters.size(); i++)
+			if (clusters[i].timecode * timecodeScale <= start)
+				first = i;
+		clusters.erase(clusters.begin(), clusters.begin() + first);
+		if (clusters.empty() || clusters.front().timecode * timecodeScale >= end)
+			throw std::runtime_error("EBMLExtractor::Extract(). No Cluster of " + reader.GetFilename() + " starts before the end of the range.");
+
+		Result result;
+		result.clusters = clusters.size();
+		result.firstTimecode = clusters.front().timecode;
+		result.lastTimecode = clusters.back().timecode;
+		uint64_t shift = rebase ? result.firstTimecode : 0;
+
+		const uint64_t timecodeId = EBMLElement::Find("Timecode").GetElementId();
+		const std::set<uint64_t> replacedIds = { EBMLElement::Find("CRC-32").GetElementId(), timecodeId, EBMLElement::Find("Position").GetElementId(), EBMLElement::Find("PrevSize").GetElementId() };
+		int in = open(reader.GetFilename().c_str(), O_RDONLY);
+		if (in < 0)
+			throw std::runtime_error("EBMLExtractor::Extract(). The file: " + reader.GetFilename() + " is inaccessable");
+
+		// Only the leading CRC-32 (it covers the old Timecode), Timecode, Position and PrevSize are replaced
+		std::vector<ClusterPlan> plans(clusters.size());
+		int64_t lastTime = 0;
+		for (size_t i = 0; i < clusters.size(); i++)
+		{
+			const EBMLClusterScanner::Cluster & cluster = clusters[i];
+			uint8_t bytes[64];
+			ssize_t length = pread(in, bytes, std::min<size_t>(sizeof(bytes), cluster.position + cluster.size - cluster.dataPosition), cluster.dataPosition);
+			size_t skip = 0;
+			bool timecode = false;
+			EBMLFileWindow::Header child;
+			while (length > 0 && skip < (size_t) length && EBMLFileWindow::ParseHeader(bytes + skip, length - skip, child) && !child.unknownSize && replacedIds.count(child.id))
+			{
+				timecode |= child.id == timecodeId;
+				skip += child.headerLength + child.dataSize;
+			}
+			if (!timecode || skip > cluster.position + cluster.size - cluster.dataPosition)
+			{
+				close(in);
+				throw std::runtime_error("EBMLExtractor::Extract(). The Cluster at " + std::to_string(cluster.position) + " does not start with its Timecode.");
+			}
+
+			ClusterPlan & plan = plans[i];
+			plan.timecode.reset(new EBMLWriteElement(EBMLElement::Find("Timecode")));
+			plan.timecode->SetUintData(cluster.timecode - shift);
+			plan.rest = cluster.dataPosition + skip;
+			plan.restLength = cluster.position + cluster.size - plan.rest;
+			plan.headerLength = EBMLFileWindow::EncodeHeader(EBMLElement::Find("Cluster").GetElementId(), plan.timecode->GetElementByteLength() + plan.restLength, plan.header);
+			for (auto & block : cluster.blocks)
+				lastTime = std::max<int64_t>(lastTime, (int64_t) (cluster.timecode - shift) + block.block.GetTimecode());
+		}
+
+		// Info without the UIDs that tie it to the source (and its linked segments), with the new Duration
+		std::vector<Part> parts;
+		EBMLWriteElement * info = new EBMLWriteElement(infos.at(0));
+		parts.push_back(Part { infos.at(0).GetElementId(), std::unique_ptr<EBMLWriteElement>(info), 0, 0 });
+		auto & infoChildren = info->Children();
+		infoChildren.erase(std::remove_if(infoChildren.begin(), infoChildren.end(), [](const std::unique_ptr<EBMLWriteElement> & child) {
+			return child->GetElementName() == "SegmentUID" || child->GetElementName() == "PrevUID" || child->GetElementName() == "NextUID";
+		}), infoChildren.end());
+		auto durations = info->Children(EBMLElement::Find("Duration"));
+		if (durations.size() == 0)
+		{
+			infoChildren.push_back(std::unique_ptr<EBMLWriteElement>(new EBMLWriteElement(EBMLElement::Find("Duration"))));
+			durations.push_back(infoChildren.back().get());
+		}
+		durations.at(0)->SetFloatData((double) lastTime);
+		info->Validate();
+		for (auto & name : { "Tracks", "Tags", "Attachments" })
+			for (auto & element : reader.FastSearch(EBMLElement::Find(name)))
+				parts.push_back(Part { element.GetElementId(), std::unique_ptr<EBMLWriteElement>(), element.GetElementPosition(), element.GetElementByteLength() });
+		for (auto & part : parts)
+			if (part.element)
+				part.length = part.element->GetElementByteLength();
+
+		// Cue rules of EBMLParser::GenerateCues
+		std::set<uint64_t> videoTracks, allTracks;
+		for (auto & track : TrackEntry::DecodeAll(tracks.at(0)))
+		{
+			allTracks.insert(track.trackNumber);
+			if (track.trackType == 1)
+				videoTracks.insert(track.trackNumber);
+		}
+		std::set<uint64_t> cueTracks = videoTracks.empty() ? allTracks : videoTracks;
+		bool firstPerCluster = videoTracks.empty();
+		std::vector<EBMLCueIndex::CueEntry> cueEntries; // clusterPosition holds the index into clusters until the layout is known
+		for (size_t i = 0; i < clusters.size(); i++)
+		{
+			std::set<uint64_t> cued;
+			for (auto & block : clusters[i].blocks)
+			{
+				uint64_t track = block.block.GetTrackNumber();
+				if (!block.keyframe || cueTracks.count(track) == 0 || (firstPerCluster && cued.count(track) > 0))
+					continue;
+				int64_t time = (int64_t) (clusters[i].timecode - shift) + block.block.GetTimecode();
+				cueEntries.push_back(EBMLCueIndex::CueEntry { track, (uint64_t) std::max<int64_t>(time, 0), i, plans[i].timecode->GetElementByteLength() + block.position - plans[i].rest });
+				cued.insert(track);
+			}
+		}
+
+		// The SeekHead goes first, its length depends on the positions it holds; grown until it is stable
+		size_t segmentPosition = reader.GetRootElements(EBMLElement::Find("Segment")).at(0).GetElementPosition();
+		size_t dataPosition = segmentPosition + EBMLFileUtilities::SegmentHeaderLength;
+		EBMLWriteElement seekHead(EBMLElement::Find("SeekHead"));
+		EBMLCueIndex index;
+		index.SetSegmentDataPosition(dataPosition);
+		std::vector<size_t> clusterPositions(plans.size());
+		size_t seekHeadLength = 0, cuesPosition = 0;
+		while (true)
+		{
+			std::map<size_t, uint64_t> entries; // position, id
+			size_t position = dataPosition + seekHeadLength;
+			for (auto & part : parts)
+			{
+				entries[position] = part.id;
+				position += part.length;
+			}
+			for (size_t i = 0; i < plans.size(); i++)
+			{
+				clusterPositions[i] = position;
+				position += plans[i].Length();
+			}
+			cuesPosition = position;
+			if (cueEntries.size() > 0)
+				entries[cuesPosition] = EBMLElement::Find("Cues").GetElementId();
+
+			seekHead = EBMLParser::CreateSeekHead(entries, dataPosition);
+			if (seekHead.GetElementByteLength() == seekHeadLength)
+				break;
+			seekHeadLength = seekHead.GetElementByteLength();
+		}
+
+		for (auto & entry : cueEntries)
+			index.Add(entry.track, entry.time, clusterPositions[entry.clusterPosition] - dataPosition, entry.relativePosition);
+		result.cuePoints = index.Size();
+		EBMLWriteElement cues = index.CreateCuesElement();
+		cues.Validate();
+		size_t cuesLength = index.Size() > 0 ? cues.GetElementByteLength() : 0;
+
+		// Truncated only once it is known not to be the source (the same path, a hard or a symbolic link to it)
+		int out = open(output.c_str(), O_WRONLY | O_CREAT, 0644);
+		if (out < 0)
+		{
+			close(in);
+			throw std::runtime_error("EBMLExtractor::Extract(). The file: " + output + " is not writeable");
+		}
+		struct stat inStatus, outStatus;
+		bool regular = fstat(out, &outStatus) == 0 && S_ISREG(outStatus.st_mode); // Not a device or pipe, which are neither truncated nor removed
+		if (regular && fstat(in, &inStatus) == 0 && inStatus.st_dev == outStatus.st_dev && inStatus.st_ino == outStatus.st_ino)
+		{
+			close(in);
+			close(out);
+			throw std::invalid_argument("EBMLExtractor::Extract(). The output " + output + " is the source file.");
+		}
+		if (regular && ftruncate(out, 0) != 0)
+		{
+			close(in);
+			close(out);
+			throw std::runtime_error("EBMLExtractor::Extract(). The file: " + output + " is not writeable");
+		}
+		uint8_t segmentHeader[EBMLFileUtilities::SegmentHeaderLength];
+		EBMLFileWindow::EncodeHeader(EBMLElement::Find("Segment").GetElementId(), cuesPosition + cuesLength - dataPosition, segmentHeader, 8);
+		result.offloaded = true;
+		bool written = EBMLFileUtilities::Copy(in, 0, out, 0, segmentPosition, result.offloaded) // EBML header
+			&& EBMLFileUtilities::WriteAll(out, segmentHeader, sizeof(segmentHeader), segmentPosition)
+			&& EBMLFileUtilities::WriteElement(out, seekHead, dataPosition);
+		size_t position = dataPosition + seekHeadLength;
+		for (auto & part : parts)
+		{
+			written = written && (part.element ? EBMLFileUtilities::WriteElement(out, *part.element, position) : EBMLFileUtilities::Copy(in, part.source, out, position, part.length, result.offloaded));
+			position += part.length;
+		}
+		for (size_t i = 0; i < plans.size() && written; i++)
+		{
+			ClusterPlan & plan = plans[i];
+			written = EBMLFileUtilities::WriteAll(out, plan.header, plan.headerLength, position)
+				&& EBMLFileUtilities::WriteElement(out, *plan.timecode, position + plan.headerLength)
+				&& EBMLFileUtilities::Copy(in, plan.rest, out, position + plan.headerLength + plan.timecode->GetElementByteLength(), plan.restLength, result.offloaded);
+			result.bytesCopied += plan.restLength;
+			position += plan.Length();
+		}
+		if (written && index.Size() > 0)
+			written = EBMLFileUtilities::WriteElement(out, cues, position);
+		result.fileSize = position + cuesLength;
+		close(in);
+		close(out);
+		if (!written)
+		{
+			if (regular)
+				unlink(output.c_str()); // No partial output is left behind
+			throw std::runtime_error("EBMLExtractor::Extract(). Writing " + output + " failed");
+		}
+		return result;
+	}
+}
\ No newline at end of file
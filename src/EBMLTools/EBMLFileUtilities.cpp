@@ -0,0 +1,110 @@
+#include <EBMLTools/EBMLFileUtilities.hpp>
+#include <EBMLTools/EBMLWriteElement.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/falloc.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+
+namespace EBMLTools
+{
+	bool EBMLFileUtilities::Copy(int in, size_t inPosition, int out, size_t outPosition, size_t length, bool & offloaded)
+	{
+#ifdef __linux__
+		while (length > 0 && offloaded)
+		{
+			loff_t from = inPosition, to = outPosition;
+			ssize_t count = copy_file_range(in, &from, out, &to, length, 0);
+			if (count < 0 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP))
+				offloaded = false; // Old kernels and some file system pairs, copied through user space from here on
+			else if (count <= 0)
+				return false;
+			else
+			{
+				inPosition += count;
+				outPosition += count;
+				length -= count;
+			}
+		}
+#else
+		offloaded = false;
+#endif
+		std::vector<uint8_t> buffer(std::min<size_t>(length, 8 * 1024 * 1024));
+		while (length > 0)
+		{
+			ssize_t count = pread(in, buffer.data(), std::min(length, buffer.size()), inPosition);
+			if (count <= 0)
+				return false;
+			if (!WriteAll(out, buffer.data(), count, outPosition))
+				return false;
+			inPosition += count;
+			outPosition += count;
+			length -= count;
+		}
+		return true;
+	}
+
+	bool EBMLFileUtilities::WriteAll(int fd, const uint8_t * data, size_t length, size_t position)
+	{
+		for (ssize_t written; length > 0; data += written, length -= written, position += written)
+			if ((written = pwrite(fd, data, length, position)) <= 0)
+				return false;
+		return true;
+	}
+
+	bool EBMLFileUtilities::WriteElement(int fd, const EBMLWriteElement & element, size_t position)
+	{
+		uint8_t * bytes = element.ToBytes();
+		bool written = WriteAll(fd, bytes, element.GetElementByteLength(), position);
+		delete [] bytes;
+		return written;
+	}
+
+	bool EBMLFileUtilities::PunchHole(int fd, size_t position, size_t length)
+	{
+#ifdef __linux__
+		struct stat status;
+		if (fstat(fd, &status) != 0)
+			return false;
+		size_t size = status.st_size;
+		if (position < size && fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, position, std::min(length, size - position)) != 0)
+			return false; // EOPNOTSUPP on file systems without holes
+		return position + length <= size || ftruncate(fd, position + length) == 0;
+#else
+		return false;
+#endif
+	}
+
+	bool EBMLFileUtilities::Clone(int in, int out)
+	{
+#if defined(__linux__) && defined(FICLONE)
+		struct stat status;
+		if (fstat(in, &status) != 0 || ioctl(out, FICLONE, in) != 0)
+			return false;
+		return ftruncate(out, status.st_size) == 0;
+#else
+		errno = EOPNOTSUPP;
+		return false;
+#endif
+	}
+
+	bool EBMLFileUtilities::SyncDirectory(const std::string & path)
+	{
+		size_t slash = path.find_last_of('/');
+		std::string directory = slash == std::string::npos ? "." : path.substr(0, std::max<size_t>(slash, 1));
+		int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+		if (fd < 0)
+			return false;
+		bool synced = fsync(fd) == 0;
+		close(fd);
+		return synced;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,102 @@
+#include <EBMLTools/EBMLFileWindow.hpp>
+#include <EBMLTools/EBMLElement.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <unistd.h>
+
+namespace EBMLTools
+{
+	EBMLFileWindow::EBMLFileWindow(int fd, size_t capacity) : fd(fd), capacity(capacity) {}
+
+	const uint8_t * EBMLFileWindow::Get(size_t position, size_t wanted, size_t & available)
+	{
+		if (position < start || position + wanted > start + length)
+		{
+			buffer.resize(std::max(capacity, wanted));
+			start = position;
+			length = 0;
+			while (length < buffer.size())
+			{
+				ssize_t count = pread(fd, buffer.data() + length, buffer.size() - length, start + length);
+				if (count < 0)
+					throw std::runtime_error(std::string("EBMLFileWindow::Get(). Read failed: ") + std::strerror(errno));
+				if (count == 0)
+					break;
+				length += count;
+			}
+		}
+		available = start + length - position;
+		return buffer.data() + (position - start);
+	}
+
+	size_t EBMLFileWindow::FindUnknownSizeEnd(uint64_t id, size_t dataPosition, size_t limit)
+	{
+		size_t position = dataPosition;
+		while (position < limit)
+		{
+			Header header;
+			size_t available;
+			const uint8_t * data = Get(position, 12, available);
+			if (!ParseHeader(data, std::min(available, limit - position), header))
+				break;
+			try
+			{
+				const EBMLElement & child = EBMLElement::Find(header.id);
+				if (!child.isGlobalElement() && child.GetElementParentId() != id)
+					break;
+			}
+			catch (std::invalid_argument &)
+			{
+				break;
+			}
+			position += header.headerLength;
+			position = header.unknownSize ? FindUnknownSizeEnd(header.id, position, limit) : position + std::min<uint64_t>(header.dataSize, limit - std::min(position, limit));
+		}
+		return std::min(position, limit);
+	}
+
+	bool EBMLFileWindow::ParseHeader(const uint8_t * data, size_t length, Header & header)
+	{
+		if (length == 0 || data[0] < 0x10 || data[0] == 0xFF)
+			return false;
+		size_t idLength = 1;
+		while (!(data[0] & (0x80 >> (idLength - 1))))
+			idLength++;
+		if (length <= idLength || data[idLength] == 0)
+			return false;
+		size_t sizeLength = 1;
+		while (!(data[idLength] & (0x80 >> (sizeLength - 1))))
+			sizeLength++;
+		if (length < idLength + sizeLength)
+			return false;
+		header.id = 0;
+		for (size_t i = 0; i < idLength; i++)
+			header.id = (header.id << 8) | data[i];
+		header.dataSize = data[idLength] & (0xFF >> sizeLength);
+		for (size_t i = 1; i < sizeLength; i++)
+			header.dataSize = (header.dataSize << 8) | data[idLength + i];
+		header.unknownSize = header.dataSize == (uint64_t(1) << (7 * sizeLength)) - 1;
+		header.headerLength = idLength + sizeLength;
+		return true;
+	}
+
+	size_t EBMLFileWindow::EncodeHeader(uint64_t id, uint64_t dataSize, uint8_t * header, size_t sizeLength)
+	{
+		size_t idLength = 1;
+		while (idLength < 4 && (id >> (8 * idLength)))
+			idLength++;
+		if (sizeLength == 0)
+			for (sizeLength = 1; sizeLength < 8 && dataSize >= (uint64_t(1) << (7 * sizeLength)) - 1; sizeLength++) {}
+		for (size_t i = 0; i < idLength; i++)
+			header[i] = (uint8_t) (id >> (8 * (idLength - 1 - i)));
+		for (size_t i = 0; i < sizeLength; i++)
+			header[idLength + sizeLength - 1 - i] = (uint8_t) (dataSize >> (8 * i));
+		header[idLength] |= 0x80 >> (sizeLength - 1);
+		return idLength + sizeLength;
+	}
+}
\ No newline at end of file
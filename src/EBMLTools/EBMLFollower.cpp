@@ -0,0 +1,168 @@
+#include <EBMLTools/EBMLFollower.hpp>
+#include <EBMLTools/EBMLFileWindow.hpp>
+#include <EBMLTools/EBMLTypedElements.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+namespace EBMLTools
+{
+	EBMLFollower::EBMLFollower(EBMLReader & reader) : reader(reader)
+	{
+		position = reader.GetSegmentDataPosition();
+		cues.SetSegmentDataPosition(position);
+#ifdef __linux__
+		notifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (notifyFd >= 0 && inotify_add_watch(notifyFd, reader.GetFilename().c_str(), IN_MODIFY) < 0)
+		{
+			close(notifyFd); // e.g. network file systems, polled instead
+			notifyFd = -1;
+		}
+#endif
+	}
+
+	EBMLFollower::~EBMLFollower() { if (notifyFd >= 0) close(notifyFd); }
+
+	bool EBMLFollower::Wait(size_t timeout)
+	{
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+		while (true)
+		{
+			struct stat status;
+			if (stat(reader.GetFilename().c_str(), &status) == 0 && (size_t) status.st_size > reader.fileSize)
+				return true;
+			auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+			if (remaining <= 0)
+				return false;
+			if (notifyFd >= 0)
+			{
+				pollfd events { notifyFd, POLLIN, 0 };
+				if (poll(&events, 1, (int) remaining) > 0)
+				{
+					char buffer[4096];
+					while (read(notifyFd, buffer, sizeof(buffer)) > 0) {} // Only the size matters, the events are dropped
+				}
+			}
+			else
+				std::this_thread::sleep_for(std::chrono::milliseconds(std::min<long long>(remaining, pollInterval)));
+		}
+	}
+
+	size_t EBMLFollower::Update(bool finished)
+	{
+		reader.Refresh();
+		size_t cachedPosition = reader.GetReadPosition();
+		EBMLReadElement segment = reader.GetRootElements(EBMLElement::Find("Segment")).at(0);
+		size_t segmentEnd = segment.GetElementPosition() + segment.GetElementByteLength();
+		size_t count = 0;
+		while (position < segmentEnd && position < reader.fileSize)
+		{
+			// The header itself may still be cut off
+			uint8_t bytes[12];
+			EBMLFileWindow::Header header;
+			if (!EBMLFileWindow::ParseHeader(bytes, reader.ReadRaw(position, bytes, sizeof(bytes)), header))
+				break;
+
+			reader.SetReadPosition(position);
+			bool cached = reader.parentStructure.count(position) > 0;
+			EBMLReadElement element = reader.ReadElement(segment);
+			size_t end = position + element.GetElementByteLength();
+			if (end > reader.fileSize || (element.IsUnknownSize() && end == reader.fileSize && !finished))
+			{
+				if (!cached)
+					reader.parentStructure.erase(position);
+				break; // Still being written
+			}
+			if (element.GetElementName() == "Tracks")
+				IndexTracks(element);
+			else if (element.GetElementName() == "Cluster")
+			{
+				IndexCluster(element);
+				count++;
+			}
+			if (element.GetElementType() == Master && !cached)
+				reader.parentStructure.erase(position);
+			position = end;
+		}
+		reader.SetReadPosition(cachedPosition);
+		return count;
+	}
+
+	void EBMLFollower::IndexTracks(const EBMLReadElement & tracks)
+	{
+		std::set<uint64_t> videoTracks, allTracks;
+		for (auto & track : TrackEntry::DecodeAll(tracks))
+		{
+			allTracks.insert(track.trackNumber);
+			if (track.trackType == 1)
+				videoTracks.insert(track.trackNumber);
+		}
+		cueTracks = videoTracks.empty() ? allTracks : videoTracks;
+		firstPerCluster = videoTracks.empty();
+	}
+
+	void EBMLFollower::IndexCluster(const EBMLReadElement & cluster)
+	{
+		size_t dataPosition = cluster.GetElementPosition() + cluster.GetElementIdByteLength() + cluster.GetElementDataSizeByteLength();
+		uint64_t timecode = 0;
+		std::set<uint64_t> cued;
+		for (auto & child : cluster.ChildRange())
+		{
+			std::unique_ptr<EBMLReadElement> blockElement;
+			bool keyframe = false;
+			if (child.GetElementName() == "Timecode")
+				timecode = child.GetUintData();
+			else if (child.GetElementName() == "SimpleBlock")
+				blockElement.reset(new EBMLReadElement(child));
+			else if (child.GetElementName() == "BlockGroup")
+			{
+				bool cached = reader.parentStructure.count(child.GetElementPosition()) > 0;
+				keyframe = true;
+				for (auto & groupChild : child.ChildRange())
+				{
+					if (groupChild.GetElementName() == "Block")
+						blockElement.reset(new EBMLReadElement(groupChild));
+					else if (groupChild.GetElementName() == "ReferenceBlock")
+						keyframe = false;
+				}
+				if (!cached)
+					reader.parentStructure.erase(child.GetElementPosition());
+			}
+			if (!blockElement)
+				continue;
+
+			EBMLBlock block;
+			try
+			{
+				block = reader.ReadBlockHeader(*blockElement);
+			}
+			catch (std::runtime_error &)
+			{
+				continue; // Damaged block headers are left out
+			}
+			if (blockElement->GetElementName() == "SimpleBlock")
+				keyframe = block.IsKeyframe();
+			uint64_t track = block.GetTrackNumber();
+			if (!keyframe || cueTracks.count(track) == 0 || (firstPerCluster && cued.count(track) > 0))
+				continue;
+			int64_t time = (int64_t) timecode + block.GetTimecode();
+			cues.Add(track, (uint64_t) std::max<int64_t>(time, 0), cluster.GetElementPosition() - reader.GetSegmentDataPosition(), child.GetElementPosition() - dataPosition);
+			cued.insert(track);
+		}
+		clusters.push_back(Cluster { cluster.GetElementPosition(), cluster.GetElementByteLength(), timecode });
+	}
+
+	const std::vector<EBMLFollower::Cluster> & EBMLFollower::GetClusters() const { return clusters; }
+	const EBMLCueIndex & EBMLFollower::GetCues() const { return cues; }
+
+	bool EBMLFollower::UsesInotify() const { return notifyFd >= 0; }
+	void EBMLFollower::SetPollInterval(size_t milliseconds) { pollInterval = std::max<size_t>(milliseconds, 1); }
+}
\ No newline at end of file
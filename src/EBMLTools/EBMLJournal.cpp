@@ -0,0 +1,215 @@
+#include <EBMLTools/EBMLJournal.hpp>
+#include <EBMLTools/EBMLFileUtilities.hpp>
+#include <CRC.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace EBMLTools
+{
+	namespace
+	{
+		// Layout: magic, then per write a type byte, position and length (8 bytes each, big endian) and
+		// the data of Data records, then the commit record: its type byte, the record count and the CRC-32
+		// of everything in front of it
+		const char MAGIC[8] = { 'E', 'B', 'M', 'L', 'J', 'R', 'N', '1' };
+		const uint8_t DATA_RECORD = 0x01;
+		const uint8_t ZERO_RECORD = 0x02;
+		const uint8_t COMMIT_RECORD = 0xFF;
+
+		void PutUint(std::vector<uint8_t> & bytes, uint64_t value)
+		{
+			for (int i = 7; i >= 0; i--)
+				bytes.push_back((uint8_t) (value >> (i * 8)));
+		}
+
+		bool GetUint(const std::vector<uint8_t> & bytes, size_t & offset, uint64_t & value)
+		{
+			if (offset + 8 > bytes.size())
+				return false;
+			value = 0;
+			for (size_t i = 0; i < 8; i++)
+				value = (value << 8) | bytes[offset++];
+			return true;
+		}
+	}
+
+	EBMLJournal::EBMLJournal(const std::string & fileName) : fileName(fileName) {}
+
+	std::string EBMLJournal::PathFor(const std::string & fileName) { return fileName + ".journal"; }
+
+	void EBMLJournal::Add(size_t position, const uint8_t * data, size_t length)
+	{
+		if (length > 0)
+			writes.push_back(Write { position, length, std::vector<uint8_t>(data, data + length) });
+	}
+
+	void EBMLJournal::AddZeros(size_t position, size_t length)
+	{
+		if (length > 0)
+			writes.push_back(Write { position, length, std::vector<uint8_t>() });
+	}
+
+	bool EBMLJournal::Empty() const { return writes.empty(); }
+	void EBMLJournal::Clear() { writes.clear(); }
+
+	size_t EBMLJournal::Overlay(size_t position, uint8_t * buffer, size_t count, size_t length) const
+	{
+		size_t end = position + count;
+		for (auto & write : writes) // In order, a later write wins
+		{
+			size_t from = std::max(position, write.position), to = std::min(position + length, write.position + write.length);
+			if (from >= to)
+				continue;
+			if (from > end)
+				std::fill(buffer + (end - position), buffer + (from - position), 0); // Gap between the file end and an appended write
+			if (write.data.empty())
+				std::fill(buffer + (from - position), buffer + (to - position), 0);
+			else
+				std::copy(write.data.begin() + (from - write.position), write.data.begin() + (to - write.position), buffer + (from - position));
+			end = std::max(end, to);
+		}
+		return end - position;
+	}
+
+	size_t EBMLJournal::End() const
+	{
+		size_t end = 0;
+		for (auto & write : writes)
+			end = std::max(end, write.position + write.length);
+		return end;
+	}
+
+	bool EBMLJournal::Apply(int fd, const std::vector<Write> & writes)
+	{
+		static const std::vector<uint8_t> zeros(EBMLFileUtilities::HolePunchMinimum, 0);
+		for (auto & write : writes)
+		{
+			if (!write.data.empty())
+			{
+				if (!EBMLFileUtilities::WriteAll(fd, write.data.data(), write.length, write.position))
+					return false;
+				continue;
+			}
+			if (write.length >= EBMLFileUtilities::HolePunchMinimum && EBMLFileUtilities::PunchHole(fd, write.position, write.length))
+				continue;
+			for (size_t written = 0; written < write.length; written += zeros.size())
+				if (!EBMLFileUtilities::WriteAll(fd, zeros.data(), std::min(zeros.size(), write.length - written), write.position + written))
+					return false;
+		}
+		return true;
+	}
+
+	void EBMLJournal::Commit()
+	{
+		if (writes.empty())
+			return;
+		std::vector<uint8_t> journal(MAGIC, MAGIC + sizeof(MAGIC));
+		for (auto & write : writes)
+		{
+			journal.push_back(write.data.empty() ? ZERO_RECORD : DATA_RECORD);
+			PutUint(journal, write.position);
+			PutUint(journal, write.length);
+			journal.insert(journal.end(), write.data.begin(), write.data.end());
+		}
+		uint32_t crc = CRC::Calculate(journal.data(), journal.size(), CRC::CRC_32());
+		journal.push_back(COMMIT_RECORD);
+		PutUint(journal, writes.size());
+		PutUint(journal, crc);
+
+		std::string path = PathFor(fileName);
+		int out = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+		bool journaled = out >= 0 && EBMLFileUtilities::WriteAll(out, journal.data(), journal.size(), 0) && fsync(out) == 0; // Barrier 1
+		int error = errno;
+		if (out >= 0)
+			close(out);
+		if (journaled && !EBMLFileUtilities::SyncDirectory(path)) // Its directory entry too, or Recover may not find it after a crash
+		{
+			journaled = false;
+			error = errno;
+		}
+		if (!journaled)
+		{
+			unlink(path.c_str());
+			throw std::runtime_error("EBMLJournal::Commit(). The journal " + path + " could not be written: " + strerror(error) + ". " + fileName + " is unchanged.");
+		}
+
+		int fd = open(fileName.c_str(), O_WRONLY);
+		bool applied = fd >= 0 && Apply(fd, writes) && fsync(fd) == 0; // Barrier 2
+		error = errno;
+		if (fd >= 0)
+			close(fd);
+		if (!applied)
+			throw std::runtime_error("EBMLJournal::Commit(). Applying the journal to " + fileName + " failed: " + strerror(error) + ". It is replayed from " + path + " when the file is opened again.");
+		unlink(path.c_str());
+		writes.clear();
+	}
+
+	bool EBMLJournal::Recover(const std::string & fileName)
+	{
+		std::string path = PathFor(fileName);
+		int in = open(path.c_str(), O_RDONLY);
+		if (in < 0)
+			return false;
+		struct stat status;
+		std::vector<uint8_t> journal;
+		if (fstat(in, &status) == 0)
+		{
+			journal.resize(status.st_size);
+			size_t count = 0;
+			for (ssize_t part; count < journal.size() && (part = pread(in, journal.data() + count, journal.size() - count, count)) > 0; count += part) {}
+			journal.resize(count);
+		}
+		close(in);
+
+		// Anything short of a commit record with a matching count and CRC was never applied
+		std::vector<Write> records;
+		bool committed = false;
+		size_t offset = sizeof(MAGIC);
+		if (journal.size() >= sizeof(MAGIC) && std::equal(MAGIC, MAGIC + sizeof(MAGIC), journal.begin()))
+		{
+			while (offset < journal.size())
+			{
+				uint8_t type = journal[offset];
+				size_t recordStart = offset++;
+				uint64_t position, length;
+				if (!GetUint(journal, offset, position) || !GetUint(journal, offset, length))
+					break;
+				if (type == COMMIT_RECORD)
+				{
+					uint32_t crc = CRC::Calculate(journal.data(), recordStart, CRC::CRC_32());
+					committed = position == records.size() && length == crc && offset == journal.size();
+					break;
+				}
+				if (type == ZERO_RECORD)
+					records.push_back(Write { position, length, std::vector<uint8_t>() });
+				else if (type == DATA_RECORD && length <= journal.size() - offset)
+				{
+					records.push_back(Write { position, length, std::vector<uint8_t>(journal.begin() + offset, journal.begin() + offset + length) });
+					offset += length;
+				}
+				else
+					break;
+			}
+		}
+
+		if (committed)
+		{
+			int fd = open(fileName.c_str(), O_WRONLY);
+			bool applied = fd >= 0 && Apply(fd, records) && fsync(fd) == 0;
+			int error = errno;
+			if (fd >= 0)
+				close(fd);
+			if (!applied)
+				throw std::runtime_error("EBMLJournal::Recover(). Replaying " + path + " on " + fileName + " failed: " + strerror(error));
+		}
+		unlink(path.c_str());
+		return committed;
+	}
+}
\ No newline at end of file
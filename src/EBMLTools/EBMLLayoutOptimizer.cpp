@@ -0,0 +1,246 @@
+#include <EBMLTools/EBMLLayoutOptimizer.hpp>
+#include <EBMLTools/EBMLFileUtilities.hpp>
+#include <EBMLTools/EBMLFileWindow.hpp>
+#include <EBMLTools/EBMLParser.hpp>
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace EBMLTools
+{
+	namespace
+	{
+		// Other level 1 elements follow these
+		const std::vector<std::string> ORDER = { "Info", "Tracks", "Chapters", "Tags", "Cues", "Attachments" };
+
+		struct Element
+		{
+			uint64_t id;
+			size_t position;
+			size_t length;
+			size_t patch;		// Cluster: offset of the Position data, 0 if there is none to rewrite
+			size_t patchLength;
+		};
+
+		void FindClusterOffsets(EBMLWriteElement & element, std::vector<std::pair<EBMLWriteElement *, uint64_t>> & offsets)
+		{
+			for (auto & child : element.Children())
+			{
+				if (child->GetElementName() == "CueClusterPosition" || child->GetElementName() == "CueRefCluster")
+					offsets.push_back(std::make_pair(child.get(), child->GetUintData()));
+				else if (child->GetElementType() == Master)
+					FindClusterOffsets(*child, offsets);
+			}
+		}
+	}
+
+	EBMLLayoutOptimizer::EBMLLayoutOptimizer(EBMLReader & reader) : reader(reader) {}
+
+	void EBMLLayoutOptimizer::SetPadding(size_t bytes) { padding = bytes == 1 ? 2 : bytes; } // A Void takes at least 2 bytes
+
+	EBMLLayoutOptimizer::Result EBMLLayoutOptimizer::Write(const std::string & output)
+	{
+		const uint64_t clusterId = EBMLElement::Find("Cluster").GetElementId();
+		const uint64_t cuesId = EBMLElement::Find("Cues").GetElementId();
+		const uint64_t crc32Id = EBMLElement::Find("CRC-32").GetElementId();
+		const uint64_t positionId = EBMLElement::Find("Position").GetElementId();
+		const std::set<uint64_t> droppedIds = { EBMLElement::Find("SeekHead").GetElementId(), EBMLElement::Find("Void").GetElementId(), crc32Id };
+		const std::set<uint64_t> clusterStartIds = { EBMLElement::Find("Timecode").GetElementId(), EBMLElement::Find("PrevSize").GetElementId() };
+		std::vector<uint64_t> order;
+		for (auto & name : ORDER)
+			order.push_back(EBMLElement::Find(name).GetElementId());
+
+		int in = open(reader.GetFilename().c_str(), O_RDONLY);
+		struct stat status;
+		if (in < 0 || fstat(in, &status) != 0)
+			throw std::runtime_error("EBMLLayoutOptimizer::Write(). The file: " + reader.GetFilename() + " is inaccessable");
+		EBMLReadElement segment = reader.GetRootElements(EBMLElement::Find("Segment")).at(0);
+		size_t segmentPosition = segment.GetElementPosition();
+		size_t sourceDataPosition = reader.GetSegmentDataPosition();
+		size_t segmentEnd = segmentPosition + segment.GetElementByteLength();
+		if (segmentEnd > (size_t) status.st_size)
+		{
+			close(in);
+			throw std::runtime_error("EBMLLayoutOptimizer::Write(). " + reader.GetFilename() + " is truncated.");
+		}
+
+		// Level 1 headers only, the first bytes of every Cluster for its Position
+		std::vector<Element> metadata, clusters;
+		EBMLFileWindow window(in, 4 * 1024 * 1024);
+		for (size_t position = sourceDataPosition; position < segmentEnd; )
+		{
+			size_t available;
+			const uint8_t * bytes = window.Get(position, 12, available);
+			EBMLFileWindow::Header header;
+			if (!EBMLFileWindow::ParseHeader(bytes, available, header))
+			{
+				close(in);
+				throw std::runtime_error("EBMLLayoutOptimizer::Write(). " + reader.GetFilename() + " is damaged at " + std::to_string(position) + ", salvage it first.");
+			}
+			size_t dataPosition = position + header.headerLength;
+			Element element { header.id, position, header.unknownSize ? window.FindUnknownSizeEnd(header.id, dataPosition, segmentEnd) - position : header.headerLength + header.dataSize, 0, 0 };
+			if (position + element.length > segmentEnd)
+			{
+				close(in);
+				throw std::runtime_error("EBMLLayoutOptimizer::Write(). The element at " + std::to_string(position) + " runs past the end of the segment.");
+			}
+			if (header.id == clusterId)
+			{
+				bytes = window.Get(dataPosition, 64, available);
+				available = std::min(available, position + element.length - dataPosition);
+				EBMLFileWindow::Header child;
+				for (size_t offset = 0; offset < available && EBMLFileWindow::ParseHeader(bytes + offset, available - offset, child); offset += child.headerLength + child.dataSize)
+				{
+					if (child.id == crc32Id)
+						break; // Patching Position would invalidate the checksum
+					if (child.id == positionId && child.dataSize >= 1 && child.dataSize <= 8)
+					{
+						element.patch = dataPosition - position + offset + child.headerLength;
+						element.patchLength = child.dataSize;
+					}
+					else if (!clusterStartIds.count(child.id))
+						break;
+				}
+				clusters.push_back(element);
+			}
+			else if (!droppedIds.count(header.id))
+				metadata.push_back(element);
+			position += element.length;
+		}
+		if (clusters.empty())
+		{
+			close(in);
+			throw std::runtime_error("EBMLLayoutOptimizer::Write(). " + reader.GetFilename() + " has no Clusters.");
+		}
+		std::stable_sort(metadata.begin(), metadata.end(), [&](const Element & a, const Element & b) {
+			return std::find(order.begin(), order.end(), a.id) - order.begin() < std::find(order.begin(), order.end(), b.id) - order.begin();
+		});
+
+		// Cues are rewritten, everything else in front of the Clusters is copied as it is
+		std::map<size_t, std::unique_ptr<EBMLWriteElement>> cues; // Index into metadata
+		std::vector<std::pair<EBMLWriteElement *, uint64_t>> offsets;
+		for (size_t i = 0; i < metadata.size(); i++)
+		{
+			if (metadata[i].id != cuesId)
+				continue;
+			EBMLReadElement element = reader.GetElement(metadata[i].position);
+			cues[i].reset(new EBMLWriteElement(element));
+			FindClusterOffsets(*cues[i], offsets);
+		}
+		std::map<uint64_t, size_t> clusterIndex; // Source position relative to the segment data, index into clusters
+		for (size_t i = 0; i < clusters.size(); i++)
+			clusterIndex[clusters[i].position - sourceDataPosition] = i;
+
+		// SeekHead and Cues lengths depend on the offsets they hold; both only grow, so this settles
+		size_t dataPosition = segmentPosition + EBMLFileUtilities::SegmentHeaderLength;
+		std::vector<size_t> clusterPositions(clusters.size());
+		EBMLWriteElement seekHead(EBMLElement::Find("SeekHead"));
+		size_t seekHeadLength = 0, clustersPosition = 0;
+		while (true)
+		{
+			bool changed = false;
+			size_t position = dataPosition + seekHeadLength;
+			std::map<size_t, uint64_t> entries; // position, id
+			for (size_t i = 0; i < metadata.size(); i++)
+			{
+				if (cues.count(i))
+					metadata[i].length = cues[i]->GetElementByteLength();
+				if (std::find(order.begin(), order.end(), metadata[i].id) != order.end())
+					entries[position] = metadata[i].id;
+				position += metadata[i].length;
+			}
+			position += padding;
+			clustersPosition = position;
+			for (size_t i = 0; i < clusters.size(); i++)
+			{
+				clusterPositions[i] = position;
+				position += clusters[i].length;
+			}
+
+			for (auto & offset : offsets)
+			{
+				auto cluster = clusterIndex.find(offset.second);
+				if (cluster != clusterIndex.end()) // Offsets that point at no Cluster are left alone
+					offset.first->SetUintData(clusterPositions[cluster->second] - dataPosition);
+			}
+			for (auto & element : cues)
+			{
+				size_t length = element.second->GetElementByteLength();
+				element.second->Validate();
+				changed |= element.second->GetElementByteLength() != length;
+			}
+
+			seekHead = EBMLParser::CreateSeekHead(entries, dataPosition);
+			changed |= seekHead.GetElementByteLength() != seekHeadLength;
+			seekHeadLength = seekHead.GetElementByteLength();
+			if (!changed)
+				break;
+		}
+
+		// With the permissions of the source, as it replaces it
+		int out = open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, status.st_mode & 07777);
+		if (out < 0 || fchmod(out, status.st_mode & 07777) != 0)
+		{
+			close(in);
+			throw std::runtime_error("EBMLLayoutOptimizer::Write(). The file: " + output + " is not writeable");
+		}
+		Result result;
+		result.offloaded = true;
+		result.clusters = clusters.size();
+		result.metadataLength = clustersPosition - dataPosition;
+		result.fileSize = clusterPositions.back() + clusters.back().length;
+
+		uint8_t header[12];
+		EBMLFileWindow::EncodeHeader(EBMLElement::Find("Segment").GetElementId(), result.fileSize - dataPosition, header, 8);
+		bool written = EBMLFileUtilities::Copy(in, 0, out, 0, segmentPosition, result.offloaded) // EBML header
+			&& EBMLFileUtilities::WriteAll(out, header, EBMLFileUtilities::SegmentHeaderLength, segmentPosition)
+			&& EBMLFileUtilities::WriteElement(out, seekHead, dataPosition);
+		size_t position = dataPosition + seekHeadLength;
+		for (size_t i = 0; i < metadata.size() && written; i++)
+		{
+			written = cues.count(i) ? EBMLFileUtilities::WriteElement(out, *cues[i], position) : EBMLFileUtilities::Copy(in, metadata[i].position, out, position, metadata[i].length, result.offloaded);
+			position += metadata[i].length;
+		}
+		if (written && padding > 0)
+		{
+			// Only the Void header is written, the new file reads as zeros up to the first Cluster
+			size_t sizeLength = 1;
+			while (padding - 1 - sizeLength >= (uint64_t(1) << (7 * sizeLength)) - 1)
+				sizeLength++;
+			size_t length = EBMLFileWindow::EncodeHeader(EBMLElement::Find("Void").GetElementId(), padding - 1 - sizeLength, header, sizeLength);
+			written = EBMLFileUtilities::WriteAll(out, header, length, position);
+		}
+		for (size_t first = 0, last; first < clusters.size() && written; first = last)
+		{
+			// Clusters adjacent in the source (no Void or other element in between) are moved in one copy
+			size_t length = clusters[first].length;
+			for (last = first + 1; last < clusters.size() && clusters[last].position == clusters[last - 1].position + clusters[last - 1].length; last++)
+				length += clusters[last].length;
+			written = EBMLFileUtilities::Copy(in, clusters[first].position, out, clusterPositions[first], length, result.offloaded);
+			result.bytesCopied += length;
+			result.copies++;
+			for (size_t i = first; i < last && written; i++)
+			{
+				uint64_t value = clusterPositions[i] - dataPosition;
+				if (clusters[i].patch == 0 || (clusters[i].patchLength < 8 && value >> (8 * clusters[i].patchLength)))
+					continue; // Too narrow for the new offset, left stale as Position is only a hint
+				uint8_t bytes[8];
+				for (size_t b = 0; b < clusters[i].patchLength; b++)
+					bytes[clusters[i].patchLength - 1 - b] = (uint8_t) (value >> (8 * b));
+				written = EBMLFileUtilities::WriteAll(out, bytes, clusters[i].patchLength, clusterPositions[i] + clusters[i].patch);
+			}
+		}
+		written = written && fsync(out) == 0; // On disk before it can be renamed over the source
+		close(in);
+		close(out);
+		if (!written)
+			throw std::runtime_error("EBMLLayoutOptimizer::Write(). Writing " + output + " failed");
+		return result;
+	}
+}
\ No newline at end of file
@@ -1,6 +1,18 @@
 #include <EBMLTools/EBMLParser.hpp>
+#include <EBMLTools/EBMLTypedElements.hpp>
+#include <EBMLTools/EBMLClusterScanner.hpp>
+#include <EBMLTools/EBMLFileUtilities.hpp>
+#include <EBMLTools/EBMLFileWindow.hpp>
 
 #include <algorithm>
+#include <set>
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace EBMLTools
 {
@@ -8,6 +20,7 @@ namespace EBMLTools
 	EBMLParser::EBMLParser(std::string file, bool dataIntegrityCheck) { OpenFile(file, dataIntegrityCheck); }
 	void EBMLParser::OpenFile(std::string file, bool dataIntegrityCheck)
 	{
+		EBMLJournal::Recover(file); // An edit interrupted by a crash
 		EBMLReader::OpenFile(file, dataIntegrityCheck);
 		fileStream.close();
 		fileStream.clear();
@@ -75,16 +88,17 @@ namespace EBMLTools
 		}
 	}
 
-	EBMLWriteElement EBMLParser::CreateSeekHead()
+	EBMLWriteElement EBMLParser::CreateSeekHead() { return CreateSeekHead(seekHead, segmentDataPosition); }
+
+	EBMLWriteElement EBMLParser::CreateSeekHead(const std::map<size_t, uint64_t> & entries, size_t segmentDataPosition)
 	{
-		EBMLReadElement segment = GetRootElements(EBMLElement::Find("Segment")).at(0);
 		EBMLWriteElement eleSeekHead(EBMLElement::Find("SeekHead"));
-		for (auto & seek : seekHead)
+		for (auto & seek : entries)
 		{
 			auto eleSeek = std::make_unique<EBMLWriteElement>(EBMLElement::Find("Seek"));
 			auto eleSeekPosition = std::make_unique<EBMLWriteElement>(EBMLElement::Find("SeekPosition"));
 			auto eleSeekID = std::make_unique<EBMLWriteElement>(EBMLElement::Find("SeekID"));
-			eleSeekPosition->SetUintData(seek.first - segment.GetElementPosition() - segment.GetElementIdByteLength() - segment.GetElementDataSizeByteLength());
+			eleSeekPosition->SetUintData(seek.first - segmentDataPosition);
 			eleSeekID->SetUintData(seek.second);
 			eleSeek->Children().push_back(std::move(eleSeekID));
 			eleSeek->Children().push_back(std::move(eleSeekPosition));
@@ -98,7 +112,7 @@ namespace EBMLTools
 	{
 		SetWritePosition(ele.GetElementPosition());
 		if (ele.GetElementByteLength() == wele.GetElementByteLength())
-			RawWrite(wele);
+			RewriteElement(ele, wele);
 		else
 		{
 			uint64_t diff = ele.GetElementByteLength() - wele.GetElementByteLength();
@@ -106,7 +120,7 @@ namespace EBMLTools
 				wele.dataSizeByteLength++;
 				RawWrite(wele);
 			} else {
-				RawWrite(wele);
+				RewriteElement(ele, wele);
 				EBMLWriteElement voidEle = CreateVoid(diff);
 				RawWrite(voidEle);
 				MergeConsecutiveVoidElements();
@@ -114,6 +128,400 @@ namespace EBMLTools
 		}
 	}
 
+	size_t EBMLParser::PaddingFor(size_t length) const
+	{
+		size_t reserved = paddingMode == PaddingMode::Bytes ? padding : paddingMode == PaddingMode::Percent ? length * padding / 100 : 0;
+		return reserved == 1 ? 2 : reserved; // A Void takes at least 2 bytes
+	}
+
+	bool EBMLParser::GrowInPlace(EBMLReadElement & ele, EBMLWriteElement & wele)
+	{
+		// The element and the Voids right behind it, the room reserved when it was last written
+		EBMLReadElement segment = GetRootElements(EBMLElement::Find("Segment")).at(0);
+		size_t end = std::min(segment.GetElementPosition() + segment.GetElementByteLength(), fileSize);
+		size_t room = ele.GetElementByteLength();
+		while (ele.GetElementPosition() + room < end && room < wele.GetElementByteLength())
+		{
+			EBMLReadElement next = GetElement(ele.GetElementPosition() + room);
+			if (next.GetElementName() != "Void")
+				break;
+			room += next.GetElementByteLength();
+		}
+		if (room < wele.GetElementByteLength())
+			return false;
+
+		size_t remainder = room - wele.GetElementByteLength();
+		if (remainder == 1) // Too small for a Void, the size is written one byte longer instead
+			wele.dataSizeByteLength++;
+		SetWritePosition(ele.GetElementPosition());
+		RawWrite(wele);
+		if (remainder > 1)
+		{
+			EBMLWriteElement voidEle = CreateVoid(remainder);
+			RawWrite(voidEle);
+		}
+		// Masters cached inside the old element and the Voids are gone
+		parentStructure.erase(parentStructure.lower_bound(ele.GetElementPosition()), parentStructure.lower_bound(ele.GetElementPosition() + room));
+		return true;
+	}
+
+	EBMLReadElement * EBMLParser::FindVoid(std::vector<EBMLReadElement> & voids, size_t length) const
+	{
+		// One that keeps the padding free behind the element first, then any that fits
+		for (auto & voidEle : voids)
+			if (voidEle.GetElementByteLength() >= length + PaddingFor(length))
+				return &voidEle;
+		for (auto & voidEle : voids)
+			if (voidEle.GetElementByteLength() >= length)
+				return &voidEle;
+		return NULL;
+	}
+
+	void EBMLParser::AppendPadded(EBMLWriteElement & wele)
+	{
+		AppendElement(wele);
+		size_t reserved = PaddingFor(wele.GetElementByteLength());
+		if (reserved > 0)
+		{
+			EBMLWriteElement voidEle = CreateVoid(reserved);
+			AppendElement(voidEle);
+		}
+	}
+
+	EBMLParser::Transaction::Transaction(EBMLParser & parser) : parser(parser)
+	{
+		outermost = parser.transactionDepth == 0;
+		if (outermost && parser.snapshots)
+		{
+			parser.TakeSnapshot();
+			taken = true;
+		}
+		parser.transactionDepth++;
+	}
+
+	EBMLParser::Transaction::~Transaction()
+	{
+		parser.transactionDepth--;
+		if (!outermost || committed)
+			return;
+		try
+		{
+			if (parser.journal)
+				parser.journal->Clear();
+			if (taken)
+				parser.RestoreSnapshot();
+			else if (parser.journal)
+				parser.Reload(); // The file is untouched, only what was cached from the journaled writes is dropped
+		}
+		catch (std::exception &) {} // A snapshot is kept for SetSnapshots to roll back to on the next open
+	}
+
+	void EBMLParser::Transaction::Commit()
+	{
+		if (!outermost)
+			return;
+		if (parser.journal)
+		{
+			parser.fileStream.flush();
+			parser.journal->Commit();
+			parser.SetReadPosition(parser.GetReadPosition()); // Drops what the stream buffered of the file before
+		}
+		if (taken)
+			parser.DropSnapshot();
+		committed = true;
+	}
+
+	std::string EBMLParser::SnapshotPath() const { return fileName + ".snapshot"; }
+
+	void EBMLParser::TakeSnapshot()
+	{
+		// A crash while cloning leaves only the temporary file, so <file>.snapshot is always a whole copy
+		fileStream.flush();
+		std::string temporary = SnapshotPath() + ".tmp";
+		int in = open(fileName.c_str(), O_RDONLY);
+		int out = in >= 0 ? open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600) : -1;
+		bool cloned = out >= 0 && EBMLFileUtilities::Clone(in, out) && fsync(out) == 0;
+		int error = errno;
+		if (in >= 0)
+			close(in);
+		if (out >= 0)
+			close(out);
+		if (cloned && (rename(temporary.c_str(), SnapshotPath().c_str()) != 0 || !EBMLFileUtilities::SyncDirectory(fileName)))
+		{
+			error = errno;
+			cloned = false;
+			unlink(SnapshotPath().c_str());
+		}
+		if (!cloned)
+		{
+			unlink(temporary.c_str());
+			throw std::runtime_error("EBMLParser::TakeSnapshot(). No reflink snapshot of " + fileName + " could be taken: " + strerror(error));
+		}
+	}
+
+	bool EBMLParser::SnapshotIsComplete() const
+	{
+		int fd = open(SnapshotPath().c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+		struct stat status;
+		bool complete = fstat(fd, &status) == 0;
+		size_t size = complete ? status.st_size : 0;
+		EBMLFileWindow window(fd, 64);
+		EBMLFileWindow::Header ebml, segment;
+		size_t available;
+		const uint8_t * data = window.Get(0, 12, available);
+		complete = complete && EBMLFileWindow::ParseHeader(data, available, ebml) && ebml.id == EBMLElement::Find("EBML").GetElementId()
+			&& !ebml.unknownSize && ebml.dataSize < size;
+		if (complete)
+		{
+			size_t segmentPosition = ebml.headerLength + ebml.dataSize;
+			data = window.Get(segmentPosition, 12, available);
+			complete = EBMLFileWindow::ParseHeader(data, available, segment) && segment.id == EBMLElement::Find("Segment").GetElementId()
+				&& (segment.unknownSize || segment.dataSize <= size - std::min(size, segmentPosition + segment.headerLength));
+		}
+		close(fd);
+		return complete;
+	}
+
+	void EBMLParser::DropSnapshot()
+	{
+		// The edit has to be on disk before the way back is removed; if it cannot be, the Transaction rolls back
+		fileStream.flush();
+		int fd = open(fileName.c_str(), O_RDONLY);
+		bool synced = fd >= 0 && fsync(fd) == 0;
+		int error = errno;
+		if (fd >= 0)
+			close(fd);
+		if (!synced)
+			throw std::runtime_error("EBMLParser::DropSnapshot(). " + fileName + " could not be synced: " + strerror(error));
+		unlink(SnapshotPath().c_str());
+	}
+
+	void EBMLParser::RestoreSnapshot()
+	{
+		std::string file = fileName;
+		fileStream.close();
+		int in = open(SnapshotPath().c_str(), O_RDONLY);
+		int out = in >= 0 ? open(file.c_str(), O_WRONLY) : -1;
+		bool cloned = out >= 0 && EBMLFileUtilities::Clone(in, out) && fsync(out) == 0;
+		int error = errno;
+		if (in >= 0)
+			close(in);
+		if (out >= 0)
+			close(out);
+		if (!cloned)
+			throw std::runtime_error("EBMLParser::RestoreSnapshot(). " + file + " could not be rolled back to " + SnapshotPath() + ": " + strerror(error));
+		unlink(SnapshotPath().c_str());
+		Reload();
+	}
+
+	void EBMLParser::Reload()
+	{
+		// Everything cached describes the edited file
+		std::string file = fileName;
+		bool dataIntegrityCheck = integrityCheck;
+		CloseFile();
+		firstSeekHead.reset();
+		OpenFile(file, dataIntegrityCheck);
+	}
+
+	void EBMLParser::SetJournal(bool enabled)
+	{
+		if (enabled && !journal)
+			journal.reset(new EBMLJournal(fileName));
+		else if (!enabled)
+			journal.reset();
+	}
+
+	size_t EBMLParser::ReadBytes(uint8_t * buffer, size_t length)
+	{
+		if (!journal || journal->Empty())
+			return EBMLReader::ReadBytes(buffer, length);
+		size_t position = GetReadPosition();
+		size_t count = EBMLReader::ReadBytes(buffer, length);
+		fileStream.clear();
+		count = journal->Overlay(position, buffer, count, length);
+		SetReadPosition(position + count);
+		if (count < length)
+			fileStream.setstate(std::ios::eofbit | std::ios::failbit); // As a short read of the file would
+		return count;
+	}
+
+	void EBMLParser::SetSnapshots(bool enabled)
+	{
+		if (enabled)
+		{
+			unlink((SnapshotPath() + ".tmp").c_str()); // Never published, the edit it was taken for did not start
+			if (access(SnapshotPath().c_str(), F_OK) == 0)
+			{
+				if (!SnapshotIsComplete())
+					throw std::runtime_error("EBMLParser::SetSnapshots(). " + SnapshotPath() + " is not a complete matroska file, " + fileName + " was not rolled back to it.");
+				RestoreSnapshot();
+			}
+			TakeSnapshot(); // Probe, refuses file systems without reflinks before anything is edited
+			unlink(SnapshotPath().c_str());
+		}
+		snapshots = enabled;
+	}
+
+	void EBMLParser::SetMergeGap(size_t bytes) { mergeGap = bytes; }
+
+	void EBMLParser::SetPadding(PaddingMode mode, size_t amount)
+	{
+		if (mode == PaddingMode::Percent && amount > MaxPaddingPercent)
+			throw std::invalid_argument("EBMLParser::SetPadding(). A padding of " + std::to_string(amount) + "% is more than the " + std::to_string(MaxPaddingPercent) + "% allowed.");
+		if (mode == PaddingMode::Bytes && amount > MaxPaddingBytes)
+			throw std::invalid_argument("EBMLParser::SetPadding(). A padding of " + std::to_string(amount) + " bytes is more than the " + std::to_string(MaxPaddingBytes) + " allowed.");
+		paddingMode = mode;
+		padding = amount;
+	}
+
+	EBMLParser::Compaction EBMLParser::CompactMetadata()
+	{
+		Transaction transaction(*this);
+		EBMLReadElement segment = GetRootElements(EBMLElement::Find("Segment")).at(0);
+		size_t regionStart = segmentDataPosition;
+		size_t regionEnd = std::min(segment.GetElementPosition() + segment.GetElementByteLength(), fileSize);
+		Compaction result;
+		std::vector<EBMLReadElement> elements;
+		for (auto & child : segment.ChildRange())
+		{
+			if (child.GetElementName() == "Cluster")
+			{
+				regionEnd = child.GetElementPosition();
+				break;
+			}
+			if (child.GetElementName() == "Void")
+				result.voids++;
+			else if (!firstSeekHead || child.GetElementPosition() != firstSeekHead->GetElementPosition())
+				elements.push_back(child);
+		}
+		size_t used = 0;
+		for (auto & element : elements)
+			used += element.GetElementByteLength();
+
+		// The SeekHead stays the first child (UpdateSeekHead relies on it). The rest keeps its order: the
+		// elements in front of the split are packed behind the SeekHead, the others against the first
+		// Cluster, and the split moving the fewest bytes wins. Its length depends on the new positions.
+		std::map<size_t, uint64_t> oldSeekHead = seekHead;
+		size_t seekHeadLength = firstSeekHead ? firstSeekHead->GetElementByteLength() : 0;
+		std::vector<size_t> positions(elements.size());
+		EBMLWriteElement newSeekHead(EBMLElement::Find("SeekHead"));
+		size_t split = 0;
+		for (size_t attempt = 0; ; attempt++)
+		{
+			if (attempt == 16)
+				throw std::runtime_error("EBMLParser::CompactMetadata(). The SeekHead length of " + fileName + " does not settle.");
+			if (regionStart + seekHeadLength + used > regionEnd)
+				throw std::runtime_error("EBMLParser::CompactMetadata(). The elements in front of the first Cluster of " + fileName + " do not fit there with the new SeekHead.");
+			size_t bestMoved = (size_t) -1;
+			for (size_t candidate = elements.size() + 1; candidate-- > 0; )
+			{
+				size_t moved = 0, front = regionStart + seekHeadLength, back = regionEnd;
+				for (size_t i = 0; i < candidate; front += elements[i++].GetElementByteLength())
+					moved += front != elements[i].GetElementPosition() ? elements[i].GetElementByteLength() : 0;
+				for (size_t i = elements.size(); i-- > candidate; )
+				{
+					back -= elements[i].GetElementByteLength();
+					moved += back != elements[i].GetElementPosition() ? elements[i].GetElementByteLength() : 0;
+				}
+				if (moved < bestMoved)
+				{
+					split = candidate;
+					bestMoved = moved;
+				}
+			}
+			size_t front = regionStart + seekHeadLength, back = regionEnd;
+			for (size_t i = 0; i < split; front += elements[i++].GetElementByteLength())
+				positions[i] = front;
+			for (size_t i = elements.size(); i-- > split; )
+				positions[i] = back -= elements[i].GetElementByteLength();
+			result.movedBytes = bestMoved;
+			if (!firstSeekHead)
+				break;
+
+			seekHead.clear();
+			for (auto & seek : oldSeekHead)
+				if (seek.first < regionStart || seek.first >= regionEnd)
+					seekHead.insert(seek);
+			for (size_t i = 0; i < elements.size(); i++)
+				if (oldSeekHead.count(elements[i].GetElementPosition()))
+					seekHead[positions[i]] = elements[i].GetElementId();
+			newSeekHead = CreateSeekHead();
+			if (newSeekHead.GetElementByteLength() <= seekHeadLength && (attempt > 0 || newSeekHead.GetElementByteLength() == seekHeadLength))
+			{
+				if (seekHeadLength - newSeekHead.GetElementByteLength() == 1) // Too small for a Void, the size is written one byte longer instead
+					newSeekHead.dataSizeByteLength++;
+				if (newSeekHead.GetElementByteLength() == seekHeadLength)
+					break;
+			}
+			seekHeadLength = newSeekHead.GetElementByteLength();
+		}
+
+		// A single free byte is too small for a Void: the element in front of it gets a size one byte longer
+		// instead. Settled before anything is written
+		size_t freeStart = split > 0 ? positions[split - 1] + elements[split - 1].GetElementByteLength() : regionStart + seekHeadLength;
+		result.freeBytes = (split < elements.size() ? positions[split] : regionEnd) - freeStart;
+		size_t widened = elements.size(); // Element index, none
+		if (result.freeBytes == 1)
+		{
+			if (split == 0 && firstSeekHead && newSeekHead.dataSizeByteLength < 8)
+				newSeekHead.dataSizeByteLength++;
+			else if (split > 0 && elements[split - 1].GetElementDataSizeByteLength() < 8)
+			{
+				widened = split - 1;
+				if (positions[widened] == elements[widened].GetElementPosition())
+					result.movedBytes += elements[widened].GetElementByteLength() + 1;
+			}
+			else
+				throw std::runtime_error("EBMLParser::CompactMetadata(). Compacting " + fileName + " would leave a single byte, too small for a Void.");
+			result.freeBytes = 0;
+		}
+
+		// Everything that moves is read before anything is written, the new places may overlap the old ones
+		std::map<size_t, std::vector<uint8_t>> moved; // Element index, bytes
+		for (size_t i = 0; i < elements.size(); i++)
+		{
+			if (positions[i] == elements[i].GetElementPosition() && i != widened)
+				continue;
+			std::vector<uint8_t> & bytes = moved[i];
+			bytes.resize(elements[i].GetElementByteLength());
+			if (ReadRaw(elements[i].GetElementPosition(), bytes.data(), bytes.size()) != bytes.size())
+				throw std::runtime_error("EBMLParser::CompactMetadata(). Reading the element at " + std::to_string(elements[i].GetElementPosition()) + " failed.");
+			if (i == widened)
+			{
+				uint8_t header[12];
+				size_t headerLength = EBMLFileWindow::EncodeHeader(elements[i].GetElementId(), elements[i].GetElementDataSize(), header, elements[i].GetElementDataSizeByteLength() + 1);
+				bytes.erase(bytes.begin(), bytes.begin() + elements[i].GetElementIdByteLength() + elements[i].GetElementDataSizeByteLength());
+				bytes.insert(bytes.begin(), header, header + headerLength);
+			}
+		}
+		for (auto & element : moved)
+		{
+			SetWritePosition(positions[element.first]);
+			Write(element.second.data(), element.second.size());
+		}
+
+		if (result.freeBytes > 0)
+		{
+			EBMLWriteElement voidEle = CreateVoid(result.freeBytes);
+			SetWritePosition(freeStart);
+			RawWrite(voidEle);
+		}
+		if (firstSeekHead)
+		{
+			SetWritePosition(regionStart);
+			RawWrite(newSeekHead);
+		}
+		fileStream.flush();
+		parentStructure.erase(parentStructure.lower_bound(regionStart), parentStructure.lower_bound(regionEnd));
+		if (firstSeekHead)
+			*firstSeekHead = GetElement(regionStart);
+		transaction.Commit();
+		return result;
+	}
+
 	bool putVoidsUpTop(EBMLReadElement i, EBMLReadElement j) { return (i.GetElementName() == "Void"); }
 
 	void EBMLParser::UpdateSeekHead()
@@ -176,7 +584,7 @@ namespace EBMLTools
 		*firstSeekHead = GetElement(seekHeadPosition);
 	}
 
-	void EBMLParser::UpdateElement(EBMLReadElement & ele, EBMLWriteElement & wele)
+	EBMLParser::UpdateResult EBMLParser::UpdateElement(EBMLReadElement & ele, EBMLWriteElement & wele)
 	{
 		if (ele != wele)
 			throw std::invalid_argument("EBMLParser::UpdateElement(). The ReadElement and WriteElement are not the same element.");
@@ -185,8 +593,19 @@ namespace EBMLTools
 		if (ele.GetElementName() == "SeekHead")
 			throw std::invalid_argument("EBMLParser::UpdateElement(). SeekHead is automatically updated as elements are updated or added. So you can't use this method for raw SeekHead manipulation");
 		wele.Validate();
-		if (ele.GetElementByteLength() < wele.GetElementByteLength())
+		if (ele.GetElementByteLength() == wele.GetElementByteLength())
+		{
+			// A retag with the same metadata: no write, no snapshot, no journal
+			std::vector<uint8_t> bytes;
+			Serialize(wele, bytes);
+			if (IsUnchanged(ele, bytes))
+				return UpdateResult::Unchanged;
+		}
+		Transaction transaction(*this);
+		UpdateResult result = UpdateResult::InPlace;
+		if (ele.GetElementByteLength() < wele.GetElementByteLength() && !GrowInPlace(ele, wele))
 		{
+			result = UpdateResult::Relocated;
 			EBMLWriteElement voidOutEle = CreateVoid(ele.GetElementByteLength());
 			SetWritePosition(ele.GetElementPosition());
 			RawWrite(voidOutEle);
@@ -194,15 +613,7 @@ namespace EBMLTools
 			if (firstSeekHead != NULL)
 				seekHead.erase(ele.GetElementPosition());
 			auto voidElements = firstSeekHead->Parent().Children(EBMLElement::Find("Void"));
-			EBMLReadElement * voidEle = NULL;
-			for (auto & i : voidElements) 
-			{
-				if (i.GetElementByteLength() >= wele.GetElementByteLength())
-				{
-					voidEle = &i;
-					break;
-				}
-			}
+			EBMLReadElement * voidEle = FindVoid(voidElements, wele.GetElementByteLength());
 			if (voidEle != NULL)
 			{
 				if (firstSeekHead != NULL)
@@ -213,13 +624,15 @@ namespace EBMLTools
 			{
 				if (firstSeekHead != NULL)
 					seekHead[fileSize] = wele.GetElementId();
-				AppendElement(wele);
+				AppendPadded(wele);
 			}
 			if (firstSeekHead != NULL)
 				UpdateSeekHead();
 		}
-		else
+		else if (ele.GetElementByteLength() >= wele.GetElementByteLength())
 			OverwriteElement(ele, wele);
+		transaction.Commit();
+		return result;
 	}
 
 	void EBMLParser::AppendElement(EBMLWriteElement & wele)
@@ -227,6 +640,8 @@ namespace EBMLTools
 		SetWritePosition(fileSize);
 		RawWrite(wele);
 		EBMLReadElement segment = GetRootElements(EBMLElement::Find("Segment")).at(0);
+		if (segment.IsUnknownSize())
+			return; // Already runs to the end of the file
 		uint64_t newDataSize = segment.GetElementDataSize() + wele.GetElementByteLength();
 		uint8_t newDataSizeByteLength = EBMLWriteElement::DetermineByteLengthOfValue(newDataSize);
 		if (newDataSizeByteLength > segment.GetElementDataSizeByteLength())
@@ -237,7 +652,7 @@ namespace EBMLTools
 		{
 			SetWritePosition(segment.GetElementPosition() + segment.GetElementIdByteLength());
 			uint8_t * size = CreateBlock(newDataSize, segment.GetElementDataSizeByteLength(), true);
-			fileStream.write((char *)size, segment.GetElementDataSizeByteLength());
+			Write(size, segment.GetElementDataSizeByteLength());
 		}
 	}
 
@@ -249,17 +664,11 @@ namespace EBMLTools
 			throw std::invalid_argument("EBMLParser::AddElement(). SeekHead is automatically updated as elements are updated or added. So you can't use this method to add SeekHead elements.");
 
 		wele.Validate();
+		Transaction transaction(*this);
 
 		EBMLReadElement segment = GetRootElements(EBMLElement::Find("Segment")).at(0);
-		EBMLReadElement * eligableVoid = NULL;
-		for (auto &voidChild : segment.Children(EBMLElement::Find("Void")))
-		{
-			if (voidChild.GetElementByteLength() >= wele.GetElementByteLength())
-			{
-				eligableVoid = &voidChild;
-				break;
-			}
-		}
+		auto voidElements = segment.Children(EBMLElement::Find("Void"));
+		EBMLReadElement * eligableVoid = FindVoid(voidElements, wele.GetElementByteLength());
 		if (eligableVoid != NULL)
 		{
 			if (firstSeekHead)
@@ -268,27 +677,217 @@ namespace EBMLTools
 		} else {
 			if (firstSeekHead)
 				seekHead[fileSize] = wele.GetElementId();
-			AppendElement(wele);
+			AppendPadded(wele);
 		}
 
 		if (firstSeekHead)
 			UpdateSeekHead();
+		transaction.Commit();
+	}
+
+	EBMLCueIndex EBMLParser::GenerateCues()
+	{
+		auto tracks = TrackEntry::DecodeAll(FastSearch(EBMLElement::Find("Tracks")).at(0));
+		std::set<uint64_t> videoTracks, allTracks;
+		for (auto & track : tracks)
+		{
+			allTracks.insert(track.trackNumber);
+			if (track.trackType == 1)
+				videoTracks.insert(track.trackNumber);
+		}
+
+		// Only block headers are decoded; without video every block may be a keyframe, so only the first one of each cluster is cued
+		std::set<uint64_t> cueTracks = videoTracks.empty() ? allTracks : videoTracks;
+		bool firstPerCluster = videoTracks.empty();
+		fileStream.flush();
+		EBMLClusterScanner scanner(*this);
+		auto partials = scanner.Scan<std::vector<EBMLCueIndex::CueEntry>>([&](std::vector<EBMLCueIndex::CueEntry> & entries, const EBMLClusterScanner::Cluster & cluster) {
+			std::set<uint64_t> cued;
+			for (auto & block : cluster.blocks)
+			{
+				uint64_t track = block.block.GetTrackNumber();
+				if (!block.keyframe || cueTracks.count(track) == 0 || (firstPerCluster && cued.count(track) > 0))
+					continue;
+				int64_t time = (int64_t) cluster.timecode + block.block.GetTimecode();
+				entries.push_back(EBMLCueIndex::CueEntry { track, (uint64_t) std::max<int64_t>(time, 0), cluster.position - segmentDataPosition, block.position - cluster.dataPosition });
+				cued.insert(track);
+			}
+		});
+
+		EBMLCueIndex index;
+		index.SetSegmentDataPosition(segmentDataPosition);
+		for (auto & entries : partials)
+			for (auto & entry : entries)
+				index.Add(entry.track, entry.time, entry.clusterPosition, entry.relativePosition);
+		if (index.Size() == 0)
+			throw std::runtime_error("EBMLParser::GenerateCues(). No keyframes were found in " + fileName);
+
+		EBMLWriteElement cues = index.CreateCuesElement();
+		auto existingCues = FastSearch(EBMLElement::Find("Cues"));
+		if (existingCues.size() > 0)
+			UpdateElement(existingCues.at(0), cues);
+		else
+			AddElement(cues);
+		return index;
+	}
+
+	void EBMLParser::WriteDuration(double duration)
+	{
+		auto found = FastSearch(EBMLElement::Find("Info"));
+		if (found.size() == 0)
+			throw std::runtime_error("EBMLParser::WriteDuration(). " + fileName + " has no Info element.");
+		EBMLReadElement info = found.at(0);
+		EBMLWriteElement wele(info);
+		auto durations = wele.Children(EBMLElement::Find("Duration"));
+		if (durations.size() > 0)
+			durations.at(0)->SetFloatData(duration);
+		else
+		{
+			std::unique_ptr<EBMLWriteElement> element(new EBMLWriteElement(EBMLElement::Find("Duration")));
+			element->SetFloatData(duration);
+			element->parent = &wele;
+			wele.Children().push_back(std::move(element));
+		}
+		UpdateElement(info, wele);
+	}
+
+	void EBMLParser::Write(const uint8_t * data, size_t length)
+	{
+		if (journal && transactionDepth > 0)
+		{
+			size_t position = GetWritePosition();
+			journal->Add(position, data, length);
+			SetWritePosition(position + length);
+		}
+		else
+			fileStream.write((const char *) data, length);
+	}
+
+	void EBMLParser::WriteZeros(size_t length)
+	{
+		size_t position = GetWritePosition();
+		if (journal && transactionDepth > 0)
+		{
+			journal->AddZeros(position, length);
+			SetWritePosition(position + length);
+			return;
+		}
+		if (length >= EBMLFileUtilities::HolePunchMinimum)
+		{
+			// Takes constant time and releases the blocks; the stream is flushed first so its buffer cannot land on the hole later
+			fileStream.flush();
+			int fd = open(fileName.c_str(), O_RDWR);
+			bool punched = fd >= 0 && EBMLFileUtilities::PunchHole(fd, position, length);
+			if (fd >= 0)
+				close(fd);
+			if (punched)
+			{
+				SetWritePosition(position + length);
+				return;
+			}
+		}
+		static const std::vector<char> zeros(EBMLFileUtilities::HolePunchMinimum, 0);
+		for (size_t written = 0; written < length; written += zeros.size())
+			fileStream.write(zeros.data(), std::min(zeros.size(), length - written));
+	}
+
+	void EBMLParser::Serialize(const EBMLWriteElement & wele, std::vector<uint8_t> & bytes)
+	{
+		uint8_t header[12];
+		size_t headerLength = EBMLFileWindow::EncodeHeader(wele.id, wele.dataSize, header, wele.dataSizeByteLength);
+		bytes.insert(bytes.end(), header, header + headerLength);
+		if (wele.GetElementId() == 0xEC)
+			bytes.resize(bytes.size() + wele.dataSize, 0);
+		else if (wele.type != Master)
+			bytes.insert(bytes.end(), wele.data, wele.data + wele.dataSize);
+		else
+			for (auto &child : wele.Children())
+				Serialize(*child, bytes);
+	}
+
+	bool EBMLParser::IsUnchanged(const EBMLReadElement & ele, const std::vector<uint8_t> & bytes)
+	{
+		if (ele.GetElementByteLength() != bytes.size())
+			return false;
+		std::vector<uint8_t> block(std::min<size_t>(bytes.size(), 1024 * 1024));
+		for (size_t offset = 0; offset < bytes.size(); offset += block.size())
+		{
+			size_t length = std::min(block.size(), bytes.size() - offset);
+			if (ReadRaw(ele.GetElementPosition() + offset, block.data(), length) != length || !std::equal(block.begin(), block.begin() + length, bytes.begin() + offset))
+				return false;
+		}
+		return true;
+	}
+
+	void EBMLParser::DiffWrite(size_t position, const std::vector<uint8_t> & bytes)
+	{
+		const size_t page = 4096;
+		std::vector<uint8_t> block(std::min<size_t>(bytes.size(), 1024 * 1024));
+		size_t rangeStart = 0, rangeEnd = 0;
+		bool open = false;
+		auto flush = [&]() {
+			SetWritePosition(position + rangeStart);
+			Write(bytes.data() + rangeStart, rangeEnd - rangeStart);
+		};
+		for (size_t offset = 0; offset < bytes.size(); offset += block.size())
+		{
+			size_t length = std::min(block.size(), bytes.size() - offset);
+			size_t count = ReadRaw(position + offset, block.data(), length);
+			for (size_t pageStart = 0; pageStart < length; pageStart += page)
+			{
+				size_t pageEnd = std::min(pageStart + page, length);
+				if (pageEnd <= count && std::equal(block.begin() + pageStart, block.begin() + pageEnd, bytes.begin() + offset + pageStart))
+					continue;
+				for (size_t i = pageStart; i < pageEnd; i++)
+				{
+					if (i < count && block[i] == bytes[offset + i])
+						continue;
+					size_t at = offset + i;
+					if (open && at - rangeEnd <= mergeGap)
+						rangeEnd = at + 1;
+					else
+					{
+						if (open)
+							flush();
+						rangeStart = at;
+						rangeEnd = at + 1;
+						open = true;
+					}
+				}
+			}
+		}
+		if (open)
+			flush();
+		SetWritePosition(position + bytes.size());
+	}
+
+	void EBMLParser::RewriteElement(const EBMLReadElement & ele, const EBMLWriteElement & wele)
+	{
+		// The same element rewritten (a Void being filled is written whole): on SMR disks and network
+		// shares a corrected summary costs a few KB instead of the whole element
+		if (ele.GetElementId() != wele.GetElementId())
+		{
+			RawWrite(wele);
+			return;
+		}
+		std::vector<uint8_t> bytes;
+		Serialize(wele, bytes);
+		DiffWrite(ele.GetElementPosition(), bytes);
 	}
 
 	void EBMLParser::RawWrite(const EBMLWriteElement & wele)
 	{
 		uint8_t * id = CreateBlock(wele.id, wele.GetElementIdByteLength(), false);
-		fileStream.write((char *)id, wele.GetElementIdByteLength());	// WRITE ID (ID is already pre-encoded)
+		Write(id, wele.GetElementIdByteLength());	// WRITE ID (ID is already pre-encoded)
 		delete [] id;
 		uint8_t * size = CreateBlock(wele.dataSize, wele.dataSizeByteLength, true);
-		fileStream.write((char *)size, wele.dataSizeByteLength);		// WRITE ENCODED SIZE
+		Write(size, wele.dataSizeByteLength);		// WRITE ENCODED SIZE
 		delete [] size;
 
 		if (wele.GetElementId() == 0xEC) // if void, write emtpy bytes;
-			for (size_t i = 0; i < wele.dataSize; i++)
-				fileStream.write((char *)&ZEROBYTE, sizeof(ZEROBYTE));
+			WriteZeros(wele.dataSize);
 		else  if (wele.type != Master) // else if Element is NOT a Master element; Has data..
-			fileStream.write((char*)wele.data, wele.dataSize);
+			Write(wele.data, wele.dataSize);
 		else	// Otherwise, recurse through children
 			for (auto &child : wele.Children())
 				RawWrite(*child);
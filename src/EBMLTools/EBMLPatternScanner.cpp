@@ -0,0 +1,133 @@
+#include <EBMLTools/EBMLPatternScanner.hpp>
+
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define EBML_PATTERN_X86
+#include <immintrin.h>
+#endif
+
+namespace EBMLTools
+{
+	EBMLPatternScanner::EBMLPatternScanner(const std::vector<uint64_t> & ids)
+	{
+		for (auto id : ids)
+		{
+			if (id < 0x10000000 || id > 0x1FFFFFFF)
+				throw std::invalid_argument("EBMLPatternScanner::EBMLPatternScanner(). Only 4 byte element ids can be scanned for.");
+			patterns.push_back((uint32_t) id);
+			firstBytes[id >> 24] = true;
+		}
+		implementation = BestImplementation();
+	}
+
+	bool EBMLPatternScanner::Matches(const uint8_t * data, size_t & index) const
+	{
+		uint32_t value = (uint32_t) data[0] << 24 | (uint32_t) data[1] << 16 | (uint32_t) data[2] << 8 | data[3];
+		for (size_t i = 0; i < patterns.size(); i++)
+		{
+			if (patterns[i] == value)
+			{
+				index = i;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	size_t EBMLPatternScanner::FindScalar(const uint8_t * data, size_t start, size_t length, size_t & index) const
+	{
+		for (size_t i = start; i + 4 <= length; i++)
+			if (firstBytes[data[i]] && Matches(data + i, index))
+				return i;
+		return NotFound;
+	}
+
+#ifdef EBML_PATTERN_X86
+	__attribute__((target("sse2")))
+	size_t EBMLPatternScanner::FindSSE2(const uint8_t * data, size_t length, size_t & index) const
+	{
+		size_t i = 0;
+		for (; i + 16 + 3 <= length; i += 16)
+		{
+			__m128i current = _mm_loadu_si128((const __m128i *) (data + i));
+			__m128i next = _mm_loadu_si128((const __m128i *) (data + i + 1));
+			__m128i candidates = _mm_setzero_si128();
+			for (auto pattern : patterns)
+			{
+				__m128i first = _mm_cmpeq_epi8(current, _mm_set1_epi8((char) (pattern >> 24)));
+				__m128i second = _mm_cmpeq_epi8(next, _mm_set1_epi8((char) (pattern >> 16)));
+				candidates = _mm_or_si128(candidates, _mm_and_si128(first, second));
+			}
+			for (unsigned mask = _mm_movemask_epi8(candidates); mask != 0; mask &= mask - 1)
+			{
+				size_t offset = i + __builtin_ctz(mask);
+				if (Matches(data + offset, index))
+					return offset;
+			}
+		}
+		return FindScalar(data, i, length, index);
+	}
+
+	__attribute__((target("avx2")))
+	size_t EBMLPatternScanner::FindAVX2(const uint8_t * data, size_t length, size_t & index) const
+	{
+		size_t i = 0;
+		for (; i + 32 + 3 <= length; i += 32)
+		{
+			__m256i current = _mm256_loadu_si256((const __m256i *) (data + i));
+			__m256i next = _mm256_loadu_si256((const __m256i *) (data + i + 1));
+			__m256i candidates = _mm256_setzero_si256();
+			for (auto pattern : patterns)
+			{
+				__m256i first = _mm256_cmpeq_epi8(current, _mm256_set1_epi8((char) (pattern >> 24)));
+				__m256i second = _mm256_cmpeq_epi8(next, _mm256_set1_epi8((char) (pattern >> 16)));
+				candidates = _mm256_or_si256(candidates, _mm256_and_si256(first, second));
+			}
+			for (unsigned mask = (unsigned) _mm256_movemask_epi8(candidates); mask != 0; mask &= mask - 1)
+			{
+				size_t offset = i + __builtin_ctz(mask);
+				if (Matches(data + offset, index))
+					return offset;
+			}
+		}
+		return FindScalar(data, i, length, index);
+	}
+#else
+	size_t EBMLPatternScanner::FindSSE2(const uint8_t * data, size_t length, size_t & index) const { return FindScalar(data, 0, length, index); }
+	size_t EBMLPatternScanner::FindAVX2(const uint8_t * data, size_t length, size_t & index) const { return FindScalar(data, 0, length, index); }
+#endif
+
+	size_t EBMLPatternScanner::Find(const uint8_t * data, size_t length, size_t & index) const
+	{
+		switch (implementation)
+		{
+			case Implementation::AVX2:
+				return FindAVX2(data, length, index);
+			case Implementation::SSE2:
+				return FindSSE2(data, length, index);
+			default:
+				return FindScalar(data, 0, length, index);
+		}
+	}
+
+	EBMLPatternScanner::Implementation EBMLPatternScanner::BestImplementation()
+	{
+#ifdef EBML_PATTERN_X86
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+			return Implementation::AVX2;
+		if (__builtin_cpu_supports("sse2"))
+			return Implementation::SSE2;
+#endif
+		return Implementation::Scalar;
+	}
+
+	EBMLPatternScanner::Implementation EBMLPatternScanner::GetImplementation() const { return implementation; }
+
+	void EBMLPatternScanner::SetImplementation(Implementation implementation)
+	{
+		Implementation best = BestImplementation();
+		this->implementation = (int) implementation > (int) best ? best : implementation;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,166 @@
+#include <EBMLTools/EBMLQuery.hpp>
+#include <EBMLTools/EBMLReader.hpp>
+
+#include <cctype>
+#include <cstdlib>
+#include <stdexcept>
+
+namespace EBMLTools
+{
+	namespace
+	{
+		bool IsNameCharacter(char c) { return std::isalnum((unsigned char) c) || c == '-'; }
+
+		std::string ReadName(const std::string & query, size_t & index)
+		{
+			size_t start = index;
+			while (index < query.size() && IsNameCharacter(query[index]))
+				index++;
+			if (start == index)
+				throw std::invalid_argument("EBMLQuery::EBMLQuery(). Expected an element name at offset " + std::to_string(start) + " in: " + query);
+			return query.substr(start, index - start);
+		}
+
+		std::string ReadValue(const std::string & query, size_t & index)
+		{
+			std::string value;
+			if (index < query.size() && query[index] == '"')
+			{
+				index++;
+				while (index < query.size() && query[index] != '"')
+				{
+					if (query[index] == '\\' && index + 1 < query.size())
+						index++;
+					value.push_back(query[index++]);
+				}
+				if (index == query.size())
+					throw std::invalid_argument("EBMLQuery::EBMLQuery(). Unterminated string in: " + query);
+				index++;
+			}
+			else
+			{
+				while (index < query.size() && query[index] != ']')
+					value.push_back(query[index++]);
+				if (value.empty())
+					throw std::invalid_argument("EBMLQuery::EBMLQuery(). Expected a value at offset " + std::to_string(index) + " in: " + query);
+			}
+			return value;
+		}
+
+		bool IsChildOf(const EBMLElement & child, const EBMLElement & parent)
+		{
+			// SimpleTag may nest inside SimpleTag even though the schema only lists Tag as its parent
+			return child.GetElementParentId() == parent.GetElementId() || child.isGlobalElement() || (child == parent && child.GetElementName() == "SimpleTag");
+		}
+	}
+
+	EBMLQuery::EBMLQuery(const std::string & query) : query(query)
+	{
+		size_t index = 0;
+		if (index < query.size() && query[index] == '/')
+			index++;
+		while (true)
+		{
+			Step step { EBMLElement::Find(ReadName(query, index)), {} };
+			while (index < query.size() && query[index] == '[')
+			{
+				index++;
+				Predicate predicate { EBMLElement::Find(ReadName(query, index)), false, "" };
+				if (query.compare(index, 2, "!=") == 0)
+				{
+					predicate.negate = true;
+					index += 2;
+				}
+				else if (index < query.size() && query[index] == '=')
+					index++;
+				else
+					throw std::invalid_argument("EBMLQuery::EBMLQuery(). Expected = or != at offset " + std::to_string(index) + " in: " + query);
+				predicate.value = ReadValue(query, index);
+				if (index == query.size() || query[index] != ']')
+					throw std::invalid_argument("EBMLQuery::EBMLQuery(). Expected ] at offset " + std::to_string(index) + " in: " + query);
+				index++;
+
+				if (step.element.GetElementType() != Master)
+					throw std::invalid_argument("EBMLQuery::EBMLQuery(). Predicates can only be applied to master elements: " + step.element.GetElementName());
+				if (predicate.element.GetElementParentId() != step.element.GetElementId())
+					throw std::invalid_argument("EBMLQuery::EBMLQuery(). " + predicate.element.GetElementName() + " is not a child of " + step.element.GetElementName());
+				ElementType type = predicate.element.GetElementType();
+				if (type == Master || type == Binary || type == Blank)
+					throw std::invalid_argument("EBMLQuery::EBMLQuery(). Cannot compare the value of " + predicate.element.GetElementName());
+				step.predicates.push_back(predicate);
+			}
+			steps.push_back(step);
+			if (index == query.size())
+				break;
+			if (query[index] != '/')
+				throw std::invalid_argument("EBMLQuery::EBMLQuery(). Unexpected character at offset " + std::to_string(index) + " in: " + query);
+			index++;
+		}
+
+		if (steps[0].element.isGlobalElement())
+			throw std::invalid_argument("EBMLQuery::EBMLQuery(), a query cannot start with a global element.");
+		if (!steps[0].element.isRootElement())
+		{
+			std::stack<EBMLElement> parents = steps[0].element.GetElementParentMap(); // Root element on top
+			std::vector<Step> anchor;
+			for (; parents.size() > 1; parents.pop())
+				anchor.push_back(Step { parents.top(), {} });
+			steps.insert(steps.begin(), anchor.begin(), anchor.end());
+		}
+		for (size_t i = 1; i < steps.size(); i++)
+			if (!IsChildOf(steps[i].element, steps[i - 1].element))
+				throw std::invalid_argument("EBMLQuery::EBMLQuery(). " + steps[i].element.GetElementName() + " is not a child of " + steps[i - 1].element.GetElementName());
+	}
+
+	const std::vector<EBMLQuery::Step> & EBMLQuery::GetSteps() const { return steps; }
+
+	bool EBMLQuery::MatchesPredicate(const Predicate & predicate, const EBMLReadElement & element)
+	{
+		bool found = false;
+		for (auto & child : element.ChildRange(predicate.element))
+		{
+			switch (child.GetElementType())
+			{
+				case String:
+				case UTF8:
+					found = child.GetStringData() == predicate.value;
+					break;
+				case Float:
+					found = child.GetFloatData() == std::strtod(predicate.value.c_str(), NULL);
+					break;
+				default:
+					found = child.GetUintData() == std::strtoull(predicate.value.c_str(), NULL, 0);
+					break;
+			}
+			if (found)
+				break;
+		}
+		return found != predicate.negate;
+	}
+
+	bool EBMLQuery::Matches(size_t depth, const EBMLReadElement & element) const
+	{
+		if (depth >= steps.size() || steps[depth].element != element)
+			return false;
+		for (auto & predicate : steps[depth].predicates)
+			if (!MatchesPredicate(predicate, element))
+				return false;
+		return true;
+	}
+
+	std::string EBMLQuery::ToString() const
+	{
+		std::string str;
+		for (auto & step : steps)
+		{
+			str += (str.empty() ? "" : "/") + step.element.GetElementName();
+			for (auto & predicate : step.predicates)
+			{
+				bool quoted = predicate.element.GetElementType() == String || predicate.element.GetElementType() == UTF8;
+				str += "[" + predicate.element.GetElementName() + (predicate.negate ? "!=" : "=")
+					+ (quoted ? "\"" + predicate.value + "\"" : predicate.value) + "]";
+			}
+		}
+		return str;
+	}
+}
\ No newline at end of file
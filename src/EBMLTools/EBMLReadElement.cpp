@@ -1,6 +1,7 @@
 #include <EBMLTools/EBMLReadElement.hpp>
 #include <EBMLTools/EBMLReader.hpp>
 #include <EBMLTools/EBMLWriteElement.hpp>
+#include <EBMLTools/EBMLChildRange.hpp>
 #include <CRC.hpp>
 #include <swap_endian.hpp>
 
@@ -9,7 +10,34 @@
 
 namespace EBMLTools
 {
+	namespace
+	{
+		// Appends every element below root to the stream in a single pass (used by ToString(true))
+		class ElementPrinter : public EBMLVisitor
+		{
+			private:
+				const EBMLReadElement & root;
+				std::stringstream & str;
+			public:
+				ElementPrinter(const EBMLReadElement & root, std::stringstream & str) : root(root), str(str) {}
+				VisitResult EnterMaster(const EBMLReadElement & element)
+				{
+					if (element != root)
+						str << element.ToString();
+					return VisitResult::Continue;
+				}
+				VisitResult Element(const EBMLReadElement & element)
+				{
+					str << element.ToString();
+					return VisitResult::Continue;
+				}
+		};
+	}
+
 	EBMLReadElement::EBMLReadElement(EBMLReader * reader, const EBMLElement & base, uint64_t dataSize, uint8_t dataSizeByteLength, size_t position)
+		: EBMLReadElement(reader, base, dataSize, dataSizeByteLength, position, NULL) {}
+
+	EBMLReadElement::EBMLReadElement(EBMLReader * reader, const EBMLElement & base, uint64_t dataSize, uint8_t dataSizeByteLength, size_t position, const EBMLReadElement * parent)
 	{
 		*this = base;
 		this->reader = reader;
@@ -17,7 +45,9 @@ namespace EBMLTools
 		this->dataSizeByteLength = dataSizeByteLength;
 		this->position = position;
 
-		if(!isRootElement() && !isGlobalElement())
+		if (!isRootElement() && !isGlobalElement() && parent != NULL && parent->id == parentId)
+			parentPosition = parent->position;
+		else if(!isRootElement() && !isGlobalElement())
 		{
 			bool found = false;
 			for (auto &masterPair : reader->parentStructure)
@@ -78,7 +108,7 @@ namespace EBMLTools
 		   << " | Pos: " << std::setw(12) << position
 		   << " | ID: 0x" << std::setw(8) << std::uppercase << std::hex << id
 		   << " (" << std::dec << int(GetElementIdByteLength()) << ") | Size: " << std::setw(12) << dataSize
-		   << " (" << int(dataSizeByteLength) << ") | Data: ";
+		   << " (" << int(dataSizeByteLength) << (unknownSize ? ", unknown" : "") << ") | Data: ";
 		switch (type)
 		{
 			case UTF8:
@@ -118,9 +148,8 @@ namespace EBMLTools
 		str << std::endl;
 		if (showChildren && type == Master)
 		{
-			auto children = Children();
-			for (auto &child : children)
-				str << child.ToString(showChildren);
+			ElementPrinter printer(*this, str);
+			reader->Walk(*this, printer);
 		}
 		return str.str();
 	}
@@ -128,6 +157,7 @@ namespace EBMLTools
 	size_t EBMLReadElement::GetElementPosition() const { return position; }
 	size_t EBMLReadElement::GetElementDataSize() const { return dataSize; }
 	size_t EBMLReadElement::GetElementDataSizeByteLength() const { return dataSizeByteLength; }
+	bool EBMLReadElement::IsUnknownSize() const { return unknownSize; }
 	size_t EBMLReadElement::GetElementByteLength() const { return GetElementIdByteLength() + dataSizeByteLength + GetElementDataSize(); }
 
 	std::vector<EBMLReadElement> EBMLReadElement::Children() const { return Children(*this); }
@@ -141,7 +171,7 @@ namespace EBMLTools
 		reader->SetReadPosition(position + GetElementIdByteLength() + dataSizeByteLength);
 		while (reader->GetReadPosition() < position + GetElementByteLength())
 		{
-			EBMLReadElement element = reader->ReadElement();
+			EBMLReadElement element = reader->ReadElement(*this);
 			if (filter == element || filter == *this)
 				children.push_back(element);
 		}
@@ -150,13 +180,25 @@ namespace EBMLTools
 		return children;
 	}
 
+	EBMLChildRange EBMLReadElement::ChildRange() const { return EBMLChildRange(*this); }
+	EBMLChildRange EBMLReadElement::ChildRange(const EBMLElement & filter) const { return EBMLChildRange(*this, filter); }
+
+	EBMLReadElement EBMLReadElement::FindFirstChild(const EBMLElement & query) const
+	{
+		EBMLChildRange range(*this, query);
+		auto first = range.begin();
+		if (first == range.end())
+			throw std::out_of_range("EBMLReadElement::FindFirstChild(). " + name + " has no " + query.GetElementName() + " child.");
+		return *first;
+	}
+
 	EBMLReadElement EBMLReadElement::FirstChild() const
 	{
 		if (type != Master)
 			throw std::runtime_error("EBMLReadElement::Children failed because it is not of Type Master");
 		size_t cachedPosition = reader->GetReadPosition();
 		reader->SetReadPosition(position + GetElementIdByteLength() + dataSizeByteLength);
-		EBMLReadElement result = reader->ReadElement();
+		EBMLReadElement result = reader->ReadElement(*this);
 		reader->SetReadPosition(cachedPosition);
 		return result;
 	}
@@ -187,7 +229,7 @@ namespace EBMLTools
 		
 		reader->SetReadPosition(startPosition);
 		uint8_t * bytes = new uint8_t[byteCount];
-		reader->fileStream.read((char *) bytes, byteCount);
+		reader->ReadBytes(bytes, byteCount);
 		uint32_t crc = CRC::Calculate(bytes, byteCount, CRC::CRC_32());
 		crc = swap_endian<uint32_t>(crc);
 		delete [] bytes;
@@ -202,7 +244,7 @@ namespace EBMLTools
 		size_t cachedposition = reader->GetReadPosition();
 		uint8_t * bytes = new uint8_t[dataSize];
 		reader->SetReadPosition(position + GetElementIdByteLength() + dataSizeByteLength);
-		reader->fileStream.read((char *) bytes, dataSize);
+		reader->ReadBytes(bytes, dataSize);
 		reader->SetReadPosition(cachedposition);
 		return bytes;
 	}
@@ -2,11 +2,47 @@
 
 namespace EBMLTools
 {
+	namespace
+	{
+		// Every open master matched the query step at its depth; anything else is skipped unread.
+		class QueryVisitor : public EBMLVisitor
+		{
+			private:
+				const EBMLQuery & query;
+				std::vector<EBMLReadElement> & results;
+				size_t depth;
+			public:
+				QueryVisitor(const EBMLQuery & query, std::vector<EBMLReadElement> & results, size_t depth = 0)
+					: query(query), results(results), depth(depth) {}
+				VisitResult EnterMaster(const EBMLReadElement & element)
+				{
+					if (!query.Matches(depth, element))
+						return VisitResult::SkipChildren;
+					if (depth == query.GetSteps().size() - 1)
+					{
+						results.push_back(element);
+						return VisitResult::SkipChildren;
+					}
+					depth++;
+					return VisitResult::Continue;
+				}
+				VisitResult Element(const EBMLReadElement & element)
+				{
+					if (depth == query.GetSteps().size() - 1 && query.Matches(depth, element))
+						results.push_back(element);
+					return VisitResult::Continue;
+				}
+				VisitResult ExitMaster(const EBMLReadElement & element)
+				{
+					depth--;
+					return VisitResult::Continue;
+				}
+		};
+	}
+
 	// PRIVATE STATIC
 	uint8_t EBMLReader::ParseBlockLength(uint8_t value)
 	{
-		if (value == 0xFF)
-			throw std::invalid_argument("Unknown Block Length's are not supported...");
 		if (value == 0x00)
 			throw std::invalid_argument("Block Length's greater than 8 bits are currently not supported");
 		uint8_t length = 0;
@@ -37,31 +73,100 @@ namespace EBMLTools
 	uint64_t EBMLReader::ReadNextBlock(uint8_t &length, bool isSize)
 	{
 		uint64_t value = 0;
-		uint8_t * bytes = new uint8_t[length];
-		fileStream.read((char *) bytes, length);
+		uint8_t maxLength = isSize ? maxSizeLength : maxIdLength;
+		if (length == 0 || length > maxLength || length > 8)
+			throw std::invalid_argument("Length of next block is not valid.. in EBMLReader::ReadNextBlock");
+		uint8_t bytes[8];
+		if (ReadBytes(bytes, length) != length)
+		{
+			fileStream.clear(); // Left usable for the caller, like ReadRaw
+			throw std::out_of_range("EBMLReader::ReadNextBlock(). The block is cut off by the end of the file.");
+		}
 		if (isSize)
 		{
 			*bytes <<= length;
 			*bytes >>= length;
 		}
-		uint8_t maxLength = isSize ? maxSizeLength : maxIdLength;
-		if (length == 0 || length > maxLength)
-			throw std::invalid_argument("Length of next block is not valid.. in EBMLReader::ReadNextBlock");
 		for (std::size_t i = length; i != 0; i--)
 			value |= (uint64_t) bytes[length - i] << ((i * 8) - 8);
-		delete [] bytes;
 		return value;
 	}
 
 	uint8_t EBMLReader::GetNextByte()
 	{
 		uint8_t nextByte;
-		fileStream.read((char *) &nextByte, sizeof(nextByte));
-		fileStream.seekg(-(sizeof(nextByte)), std::ios::cur);
+		size_t position = GetReadPosition();
+		size_t count = ReadBytes(&nextByte, sizeof(nextByte));
+		fileStream.clear();
+		SetReadPosition(position);
+		if (count != sizeof(nextByte))
+			throw std::out_of_range("EBMLReader::GetNextByte(). Reached the end of the file.");
 		return nextByte;
 	}
 
-	EBMLReadElement EBMLReader::ReadElement(ReadMode mode)
+	size_t EBMLReader::ReadBytes(uint8_t * buffer, size_t length)
+	{
+		fileStream.read((char *) buffer, length);
+		return fileStream.gcount();
+	}
+
+	uint64_t EBMLReader::ResolveUnknownSize(const EBMLElement & element, size_t position, size_t dataPosition)
+	{
+		if (element.isRootElement())
+			return fileSize - dataPosition; // A Segment written live runs to the end of the file, not cached as the file may grow
+		auto resolved = resolvedSizes.find(position);
+		if (resolved != resolvedSizes.end())
+			return resolved->second;
+
+		// The element ends at the first ID that cannot be its child, a sibling or an element of a higher level
+		size_t cachedPosition = GetReadPosition();
+		size_t childPosition = dataPosition;
+		while (childPosition < fileSize)
+		{
+			SetReadPosition(childPosition);
+			try
+			{
+				uint8_t idByteLength = ParseBlockLength(GetNextByte());
+				const EBMLElement & child = EBMLElement::Find(ReadNextBlock(idByteLength));
+				if (!child.isGlobalElement() && child.GetElementParentId() != element.GetElementId())
+					break;
+				uint8_t dataSizeByteLength = ParseBlockLength(GetNextByte());
+				uint64_t dataSize = ReadNextBlock(dataSizeByteLength, true);
+				size_t childDataPosition = GetReadPosition();
+				if (dataSize == (uint64_t(1) << (7 * dataSizeByteLength)) - 1 && child.GetElementType() == Master)
+					dataSize = ResolveUnknownSize(child, childPosition, childDataPosition);
+				childPosition = childDataPosition + dataSize;
+			}
+			catch (std::invalid_argument &)
+			{
+				break; // Not an element header (or an unknown ID), the element ends here
+			}
+			catch (std::out_of_range &)
+			{
+				childPosition = fileSize; // A child header cut off by the end of the file, which may still grow
+				break;
+			}
+		}
+		SetReadPosition(cachedPosition);
+		uint64_t dataSize = std::min(childPosition, fileSize) - dataPosition;
+		resolvedSizes[position] = dataSize;
+		return dataSize;
+	}
+
+	size_t EBMLReader::ReadRaw(size_t position, uint8_t * buffer, size_t length)
+	{
+		size_t cachedPosition = GetReadPosition();
+		SetReadPosition(position);
+		size_t count = ReadBytes(buffer, length);
+		fileStream.clear(); // A short read at the end of the file sets eof and fail
+		SetReadPosition(cachedPosition);
+		return count;
+	}
+
+	EBMLReadElement EBMLReader::ReadElement(ReadMode mode) { return ReadElement(NULL, mode); }
+	EBMLReadElement EBMLReader::ReadElement(const EBMLReadElement & parent, ReadMode mode) { return ReadElement(&parent, mode); }
+
+	EBMLReadElement EBMLReader::ReadElement(const EBMLReadElement * parent, ReadMode mode)
 	{
 		if (EndOfRead())
 			throw std::out_of_range("EBMLReader::ReadElement: Reached end of file..");
@@ -72,8 +177,18 @@ namespace EBMLTools
 		uint64_t id = ReadNextBlock(idByteLength);
 		uint8_t dataSizeByteLength = ParseBlockLength(GetNextByte());
 		uint64_t dataSize = ReadNextBlock(dataSizeByteLength, true);
+		const EBMLElement & base = EBMLElement::Find(id);
 
-		EBMLReadElement ele (this, EBMLElement::Find(id), dataSize, dataSizeByteLength, position);
+		bool unknownSize = dataSize == (uint64_t(1) << (7 * dataSizeByteLength)) - 1; // All size bits set
+		if (unknownSize)
+		{
+			if (base.GetElementType() != Master)
+				throw std::invalid_argument("EBMLReader::ReadElement(). " + base.GetElementName() + " at " + std::to_string(position) + " has an unknown size, which only master elements may have.");
+			dataSize = ResolveUnknownSize(base, position, GetReadPosition());
+		}
+
+		EBMLReadElement ele (this, base, dataSize, dataSizeByteLength, position, parent);
+		ele.unknownSize = unknownSize;
 
 		if (ele.GetElementType() == Master)
 			parentStructure[ele.GetElementPosition()] = std::make_pair(ele.GetElementByteLength(), ele.GetElementId());
@@ -122,14 +237,15 @@ namespace EBMLTools
 				maxSizeLength = child.GetUintData();
 		}
 		EBMLReadElement segment = ReadElement(); //segment
+		segmentDataPosition = segment.GetElementPosition() + segment.GetElementIdByteLength() + segment.GetElementDataSizeByteLength();
 		EBMLReadElement seekHead = segment.FirstChild();
 		if (seekHead.GetElementName() == "SeekHead")
 		{
 			firstSeekHead = std::make_unique<EBMLReadElement>(std::move(seekHead));
-			for (auto & seek : firstSeekHead->Children(EBMLElement::Find("Seek")))
+			for (auto & seek : firstSeekHead->ChildRange(EBMLElement::Find("Seek")))
 			{
-				size_t pos = seek.Children(EBMLElement::Find("SeekPosition")).at(0).GetUintData() + firstSeekHead->GetElementPosition();
-				uint64_t id = seek.Children(EBMLElement::Find("SeekID")).at(0).GetUintData();
+				size_t pos = seek.FindFirstChild(EBMLElement::Find("SeekPosition")).GetUintData() + firstSeekHead->GetElementPosition();
+				uint64_t id = seek.FindFirstChild(EBMLElement::Find("SeekID")).GetUintData();
 				this->seekHead[pos] = id;
 			}
 		}
@@ -141,8 +257,10 @@ namespace EBMLTools
 		fileStream.close();
 		fileName = "";
 		fileSize = 0;
+		segmentDataPosition = 0;
 		seekHead.clear();
 		parentStructure.clear();
+		resolvedSizes.clear();
 		maxIdLength = 4;
 		maxSizeLength = 4;
 	}
@@ -152,6 +270,34 @@ namespace EBMLTools
 		return fileName;
 	}
 
+	size_t EBMLReader::GetSegmentDataPosition() const { return segmentDataPosition; }
+
+	size_t EBMLReader::Refresh()
+	{
+		size_t cachedPosition = GetReadPosition();
+		fileStream.clear();
+		fileStream.seekg(0, std::ios::end);
+		size_t size = GetReadPosition();
+		SetReadPosition(cachedPosition);
+		if (size <= fileSize)
+			return fileSize;
+
+		// Unknown sizes resolved up to the old end may continue into the new bytes (12 bytes covers the longest header)
+		for (auto resolved = resolvedSizes.begin(); resolved != resolvedSizes.end(); )
+		{
+			if (resolved->first + 12 + resolved->second < fileSize)
+			{
+				resolved++;
+				continue;
+			}
+			parentStructure.erase(resolved->first);
+			resolved = resolvedSizes.erase(resolved);
+		}
+		fileSize = size;
+		GetRootElements(); // Records the new size of a Segment that runs to the end of the file
+		return fileSize;
+	}
+
 	void EBMLReader::DisableDataIntegrityCheck() { integrityCheck = false; }
 	void EBMLReader::EnableDataIntegrityCheck() { integrityCheck = true; }
 
@@ -240,4 +386,123 @@ namespace EBMLTools
 
 		return cache[cache.size() - 1];
 	}
-}
+
+	std::vector<EBMLReadElement> EBMLReader::Query(const std::string & query) { return Query(EBMLQuery(query)); }
+
+	std::vector<EBMLReadElement> EBMLReader::Query(const EBMLQuery & query)
+	{
+		std::vector<EBMLReadElement> results;
+		auto & steps = query.GetSteps();
+
+		// Start directly at the level 1 elements listed in the SeekHead when possible
+		if (steps.size() > 1 && steps[0].element.GetElementName() == "Segment")
+		{
+			std::vector<size_t> positions;
+			for (auto & seek : seekHead)
+				if (seek.second == steps[1].element.GetElementId())
+					positions.push_back(seek.first);
+			if (positions.size() > 0)
+			{
+				QueryVisitor visitor(query, results, 1);
+				for (auto & position : positions)
+					Walk(GetElement(position), visitor);
+				return results;
+			}
+		}
+
+		QueryVisitor visitor(query, results);
+		Walk(visitor);
+		return results;
+	}
+
+	void EBMLReader::Walk(EBMLVisitor & visitor)
+	{
+		size_t cachedPosition = GetReadPosition();
+		Walk(0, fileSize, visitor);
+		SetReadPosition(cachedPosition);
+	}
+
+	void EBMLReader::Walk(const EBMLReadElement & root, EBMLVisitor & visitor)
+	{
+		size_t cachedPosition = GetReadPosition();
+		Walk(root.GetElementPosition(), root.GetElementPosition() + root.GetElementByteLength(), visitor);
+		SetReadPosition(cachedPosition);
+	}
+
+	EBMLBlock EBMLReader::ReadBlockHeader(const EBMLReadElement & block)
+	{
+		if (block.GetElementName() != "SimpleBlock" && block.GetElementName() != "Block")
+			throw std::invalid_argument("EBMLReader::ReadBlockHeader(). " + block.GetElementName() + " is not a SimpleBlock or Block.");
+		uint8_t header[EBMLBlock::MaxHeaderLength];
+		size_t dataPosition = block.GetElementPosition() + block.GetElementIdByteLength() + block.GetElementDataSizeByteLength();
+		size_t length = ReadRaw(dataPosition, header, std::min<size_t>(sizeof(header), block.GetElementDataSize()));
+		EBMLBlock result;
+		result.ParseHeader(header, length, block.GetElementDataSize(), block.GetElementName() == "SimpleBlock");
+		return result;
+	}
+
+	void EBMLReader::ReadBlock(const EBMLReadElement & block, EBMLBlock & result, std::vector<uint8_t> & buffer)
+	{
+		if (block.GetElementName() != "SimpleBlock" && block.GetElementName() != "Block")
+			throw std::invalid_argument("EBMLReader::ReadBlock(). " + block.GetElementName() + " is not a SimpleBlock or Block.");
+		buffer.resize(block.GetElementDataSize());
+		size_t dataPosition = block.GetElementPosition() + block.GetElementIdByteLength() + block.GetElementDataSizeByteLength();
+		if (ReadRaw(dataPosition, buffer.data(), buffer.size()) != buffer.size())
+			throw std::runtime_error("EBMLReader::ReadBlock(). Block at " + std::to_string(block.GetElementPosition()) + " runs past the end of the file.");
+		result.Parse(buffer.data(), buffer.size(), block.GetElementName() == "SimpleBlock");
+	}
+
+	void EBMLReader::Walk(size_t start, size_t end, EBMLVisitor & visitor)
+	{
+		struct OpenMaster { EBMLReadElement element; size_t end; bool cached; };
+		std::vector<OpenMaster> openMasters; // Only the current branch is kept, O(depth)
+		bool stop = false;
+
+		SetReadPosition(start);
+		while (!stop)
+		{
+			while (!openMasters.empty() && GetReadPosition() >= openMasters.back().end)
+			{
+				OpenMaster closed = openMasters.back();
+				openMasters.pop_back();
+				if (!closed.cached)
+					parentStructure.erase(closed.element.GetElementPosition());
+				if (visitor.ExitMaster(closed.element) == VisitResult::Stop)
+					stop = true;
+				if (stop)
+					break;
+			}
+			if (stop || GetReadPosition() >= end || EndOfRead())
+				break;
+
+			size_t position = GetReadPosition();
+			bool cached = parentStructure.count(position) > 0; // Masters first seen by the walk are not kept in parentStructure
+			EBMLReadElement element = openMasters.empty()
+				? ReadElement(ReadMode::Descende)
+				: ReadElement(openMasters.back().element, ReadMode::Descende);
+
+			if (element.GetElementType() != Master)
+			{
+				if (visitor.Element(element) == VisitResult::Stop)
+					stop = true;
+				continue;
+			}
+
+			VisitResult result = visitor.EnterMaster(element);
+			if (result == VisitResult::Continue)
+			{
+				openMasters.push_back({ element, position + element.GetElementByteLength(), cached });
+				continue;
+			}
+			if (!cached)
+				parentStructure.erase(position);
+			if (result == VisitResult::Stop)
+				stop = true;
+			else
+				SetReadPosition(position + element.GetElementByteLength());
+		}
+		for (auto & open : openMasters)
+			if (!open.cached)
+				parentStructure.erase(open.element.GetElementPosition());
+	}
+}
\ No newline at end of file
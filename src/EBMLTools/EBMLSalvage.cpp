@@ -0,0 +1,207 @@
+#include <EBMLTools/EBMLSalvage.hpp>
+#include <EBMLTools/EBMLFileUtilities.hpp>
+#include <EBMLTools/EBMLFileWindow.hpp>
+#include <EBMLTools/EBMLParser.hpp>
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace EBMLTools
+{
+	namespace
+	{
+		const uint64_t EBML_ID = 0x1A45DFA3;
+		const uint64_t SEGMENT_ID = 0x18538067;
+		const uint64_t SEEKHEAD_ID = 0x114D9B74;
+		const uint64_t VOID_ID = 0xEC;
+
+		// Level 1 elements that are searched for after damage, and the ones a SeekHead points to
+		const std::vector<uint64_t> RESYNC_IDS = { 0x1F43B675, 0x1C53BB6B, 0x1254C367, SEEKHEAD_ID, 0x1549A966, 0x1654AE6B, 0x1043A770, 0x1941A469 };
+		const std::set<uint64_t> SEEK_IDS = { 0x1549A966, 0x1654AE6B, 0x1254C367, 0x1C53BB6B, 0x1043A770, 0x1941A469 };
+
+		const EBMLElement * FindKnown(uint64_t id)
+		{
+			try
+			{
+				return &EBMLElement::Find(id);
+			}
+			catch (std::invalid_argument &)
+			{
+				return NULL;
+			}
+		}
+	}
+
+	EBMLSalvage::EBMLSalvage(std::string fileName) : fileName(fileName), scanner(RESYNC_IDS)
+	{
+		fd = open(fileName.c_str(), O_RDONLY);
+		struct stat status;
+		if (fd < 0 || fstat(fd, &status) != 0)
+			throw std::runtime_error("EBMLSalvage::EBMLSalvage(). The file: " + fileName + " is inaccessable");
+		fileSize = status.st_size;
+	}
+
+	EBMLSalvage::~EBMLSalvage() { if (fd >= 0) close(fd); }
+
+	EBMLPatternScanner & EBMLSalvage::GetPatternScanner() { return scanner; }
+
+	bool EBMLSalvage::Accept(EBMLFileWindow & window, size_t position, size_t segmentEnd, EBMLFileWindow::Header & header) const
+	{
+		size_t available;
+		const uint8_t * data = window.Get(position, 12, available);
+		if (!EBMLFileWindow::ParseHeader(data, available, header))
+			return false;
+		const EBMLElement * element = FindKnown(header.id);
+		if (element == NULL || element->isRootElement() || (element->GetElementParentId() != SEGMENT_ID && !element->isGlobalElement()))
+			return false;
+		size_t dataPosition = position + header.headerLength;
+		if (header.unknownSize)
+		{
+			// The end is found by the caller from the children, the first one has to be sound
+			EBMLFileWindow::Header child;
+			data = window.Get(dataPosition, 12, available);
+			return element->GetElementType() == Master && EBMLFileWindow::ParseHeader(data, available, child) && FindKnown(child.id) != NULL;
+		}
+		if (header.dataSize > segmentEnd - dataPosition)
+			return false;
+		if (element->GetElementType() != Master)
+			return true;
+		size_t end = dataPosition + header.dataSize;
+		for (size_t childPosition = dataPosition; childPosition < end; )
+		{
+			EBMLFileWindow::Header child;
+			data = window.Get(childPosition, 12, available);
+			if (!EBMLFileWindow::ParseHeader(data, available, child) || child.unknownSize || FindKnown(child.id) == NULL)
+				return false;
+			if (child.dataSize > end - childPosition - child.headerLength)
+				return false;
+			childPosition += child.headerLength + child.dataSize;
+		}
+		return true;
+	}
+
+	size_t EBMLSalvage::Resync(size_t from, size_t segmentEnd) const
+	{
+		const size_t patternLength = 4;
+		EBMLFileWindow window(fd, windowSize), probe(fd, 64 * 1024);
+		size_t position = from;
+		while (position + patternLength <= segmentEnd)
+		{
+			size_t available, index;
+			const uint8_t * data = window.Get(position, patternLength, available);
+			if (available < patternLength)
+				break;
+			size_t searchLength = std::min(available, segmentEnd - position);
+			for (size_t offset = 0, match; (match = scanner.Find(data + offset, searchLength - offset, index)) != EBMLPatternScanner::NotFound; )
+			{
+				size_t candidate = position + offset + match;
+				offset += match + 1;
+				EBMLFileWindow::Header header;
+				if (Accept(probe, candidate, segmentEnd, header))
+					return candidate;
+			}
+			position += searchLength - (patternLength - 1); // Overlap so an ID across the window edge is found
+		}
+		return segmentEnd;
+	}
+
+	EBMLSalvage::Report EBMLSalvage::Scan()
+	{
+		Report report;
+		EBMLFileWindow window(fd, windowSize);
+		EBMLFileWindow::Header header;
+		size_t available;
+		const uint8_t * data = window.Get(0, 12, available);
+		if (!EBMLFileWindow::ParseHeader(data, available, header) || header.id != EBML_ID || header.unknownSize)
+			throw std::runtime_error("EBMLSalvage::Scan(). The file: " + fileName + " does not start with an EBML header");
+		size_t position = header.headerLength + header.dataSize;
+		data = window.Get(position, 12, available);
+		if (!EBMLFileWindow::ParseHeader(data, available, header) || header.id != SEGMENT_ID)
+			throw std::runtime_error("EBMLSalvage::Scan(). The EBML header of " + fileName + " is not followed by a Segment");
+		report.segmentDataPosition = position + header.headerLength;
+		report.segmentEnd = header.unknownSize ? fileSize : report.segmentDataPosition + header.dataSize;
+		if (report.segmentEnd > fileSize)
+		{
+			report.truncated = true;
+			report.segmentEnd = fileSize;
+		}
+
+		position = report.segmentDataPosition;
+		while (position < report.segmentEnd)
+		{
+			if (Accept(window, position, report.segmentEnd, header))
+			{
+				size_t end = header.unknownSize ? window.FindUnknownSizeEnd(header.id, position + header.headerLength, report.segmentEnd) : position + header.headerLength + header.dataSize;
+				report.elements.push_back(Element { header.id, position, end - position });
+				position = end;
+			}
+			else
+			{
+				size_t next = Resync(position + 1, report.segmentEnd);
+				report.damaged.push_back(DamagedRange { position, next });
+				position = next;
+			}
+		}
+		return report;
+	}
+
+	bool EBMLSalvage::RebuildSeekHead(const Report & report)
+	{
+		size_t slotEnd = report.segmentEnd;
+		for (auto & element : report.elements)
+		{
+			if (element.id != SEEKHEAD_ID && element.id != VOID_ID)
+			{
+				slotEnd = element.position;
+				break;
+			}
+		}
+
+		std::map<size_t, uint64_t> entries; // position, id
+		std::set<uint64_t> listed;
+		for (auto & element : report.elements)
+			if (SEEK_IDS.count(element.id) && listed.insert(element.id).second)
+				entries[element.position] = element.id;
+		if (listed.empty())
+			return false;
+		EBMLWriteElement seekHead = EBMLParser::CreateSeekHead(entries, report.segmentDataPosition);
+
+		size_t slot = slotEnd - report.segmentDataPosition;
+		if (seekHead.GetElementByteLength() > slot)
+			return false;
+		size_t gap = slot - seekHead.GetElementByteLength();
+		if (gap == 1) // Too small for a Void, the size of the SeekHead is written one byte longer instead
+		{
+			seekHead.dataSizeByteLength++;
+			gap = 0;
+		}
+
+		int writeFd = open(fileName.c_str(), O_WRONLY);
+		if (writeFd < 0)
+			throw std::runtime_error("EBMLSalvage::RebuildSeekHead(). The file: " + fileName + " is not writeable");
+		bool written = EBMLFileUtilities::WriteElement(writeFd, seekHead, report.segmentDataPosition);
+		if (written && gap > 0)
+		{
+			// Only the Void header is written, the bytes it covers are left as they are
+			uint8_t voidHeader[9] = { (uint8_t) VOID_ID };
+			size_t sizeLength = 1;
+			while (gap - 1 - sizeLength >= (uint64_t(1) << (7 * sizeLength)) - 1)
+				sizeLength++;
+			uint64_t voidSize = gap - 1 - sizeLength;
+			for (size_t i = 0; i < sizeLength; i++)
+				voidHeader[sizeLength - i] = (uint8_t) (voidSize >> (i * 8));
+			voidHeader[1] |= 0x80 >> (sizeLength - 1);
+			written = EBMLFileUtilities::WriteAll(writeFd, voidHeader, 1 + sizeLength, report.segmentDataPosition + seekHead.GetElementByteLength());
+		}
+		close(writeFd);
+		if (!written)
+			throw std::runtime_error("EBMLSalvage::RebuildSeekHead(). Writing the SeekHead to " + fileName + " failed");
+		return true;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,272 @@
+#include <EBMLTools/EBMLStreamWriter.hpp>
+#include <EBMLTools/EBMLFileUtilities.hpp>
+#include <EBMLTools/EBMLFileWindow.hpp>
+#include <CRC.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <unistd.h>
+
+namespace EBMLTools
+{
+	namespace
+	{
+		const uint64_t CRC32_ID = 0xBF;
+		const uint32_t CRC32_POLYNOMIAL = 0xEDB88320; // Reflected
+
+		const CRC::Table<uint32_t, 32> & Table()
+		{
+			static const CRC::Table<uint32_t, 32> table(CRC::CRC_32());
+			return table;
+		}
+
+		// a * b modulo the CRC polynomial, bit reflected
+		uint32_t MultiplyModP(uint32_t a, uint32_t b)
+		{
+			uint32_t m = uint32_t(1) << 31, p = 0;
+			while (m)
+			{
+				if (a & m)
+					p ^= b;
+				m >>= 1;
+				b = b & 1 ? (b >> 1) ^ CRC32_POLYNOMIAL : b >> 1;
+			}
+			return p;
+		}
+
+		// The CRC (without initial value and final xor) crc followed by zeroBytes zero bytes has
+		uint32_t ShiftThroughZeros(uint32_t crc, size_t zeroBytes)
+		{
+			uint32_t power = uint32_t(1) << 30; // x^1, squared up to x^(2^k) for bit k of the bit count
+			uint32_t shift = uint32_t(1) << 31;	// x^0
+			for (uint64_t bits = (uint64_t) zeroBytes * 8; bits > 0; bits >>= 1)
+			{
+				if (bits & 1)
+					shift = MultiplyModP(power, shift);
+				power = MultiplyModP(power, power);
+			}
+			return MultiplyModP(shift, crc);
+		}
+	}
+
+	EBMLStreamWriter::EBMLStreamWriter(int fd, size_t position) : fd(fd), position(position), bufferStart(position) {}
+
+	EBMLStreamWriter::~EBMLStreamWriter()
+	{
+		try
+		{
+			Flush();
+		}
+		catch (std::exception &) {}
+	}
+
+	void EBMLStreamWriter::SetBufferSize(size_t bytes) { bufferCapacity = std::max<size_t>(bytes, 4096); }
+	size_t EBMLStreamWriter::GetPosition() const { return position; }
+
+	void EBMLStreamWriter::Flush()
+	{
+		if (!buffer.empty() && !EBMLFileUtilities::WriteAll(fd, buffer.data(), buffer.size(), bufferStart))
+			throw std::runtime_error("EBMLStreamWriter::Flush(). Writing " + std::to_string(buffer.size()) + " bytes at " + std::to_string(bufferStart) + " failed: " + strerror(errno));
+		buffer.clear();
+		bufferStart = position;
+	}
+
+	void EBMLStreamWriter::Append(const uint8_t * data, size_t length)
+	{
+		for (auto & master : masters)
+			if (master.crc && position >= master.crcStart)
+				master.running = CRC::Calculate(data, length, Table(), master.running);
+		if (buffer.size() + length > bufferCapacity)
+			Flush();
+		if (length >= bufferCapacity)
+		{
+			if (!EBMLFileUtilities::WriteAll(fd, data, length, position))
+				throw std::runtime_error("EBMLStreamWriter::Append(). Writing " + std::to_string(length) + " bytes at " + std::to_string(position) + " failed: " + strerror(errno));
+			position += length;
+			bufferStart = position;
+			return;
+		}
+		buffer.insert(buffer.end(), data, data + length);
+		position += length;
+	}
+
+	void EBMLStreamWriter::Patch(size_t at, const uint8_t * before, const uint8_t * after, size_t length)
+	{
+		if (at >= bufferStart)
+			std::copy(after, after + length, buffer.begin() + (at - bufferStart));
+		else
+		{
+			// The part still buffered is patched there, the rest already written is rewritten
+			size_t written = std::min(length, bufferStart - at);
+			if (!EBMLFileUtilities::WriteAll(fd, after, written, at))
+				throw std::runtime_error("EBMLStreamWriter::Patch(). Writing " + std::to_string(written) + " bytes at " + std::to_string(at) + " failed: " + strerror(errno));
+			std::copy(after + written, after + length, buffer.begin());
+		}
+
+		// The CRCs running over these bytes saw the old ones: CRC(data ^ delta) = CRC(data) ^ CRC0(delta) shifted over the bytes behind it
+		uint8_t delta[8];
+		std::vector<uint8_t> zeros(length, 0);
+		for (size_t i = 0; i < length; i++)
+			delta[i] = before[i] ^ after[i];
+		uint32_t change = CRC::Calculate(delta, length, Table()) ^ CRC::Calculate(zeros.data(), length, Table());
+		for (auto & master : masters)
+			if (master.crc && at >= master.crcStart)
+				master.corrections.push_back(Correction { change, at + length - master.crcStart });
+	}
+
+	void EBMLStreamWriter::EncodeSize(uint64_t dataSize, size_t sizeLength, uint8_t * bytes)
+	{
+		for (size_t i = 0; i < sizeLength; i++)
+			bytes[sizeLength - 1 - i] = (uint8_t) (dataSize >> (8 * i));
+		bytes[0] |= 0x80 >> (sizeLength - 1);
+	}
+
+	size_t EBMLStreamWriter::WriteHeader(const EBMLElement & element, uint64_t dataSize, size_t sizeLength)
+	{
+		uint8_t header[12];
+		size_t headerLength = EBMLFileWindow::EncodeHeader(element.GetElementId(), dataSize, header, sizeLength);
+		size_t sizePosition = position + element.GetElementIdByteLength();
+		Append(header, headerLength);
+		return sizePosition;
+	}
+
+	void EBMLStreamWriter::Check(const EBMLElement & element, ElementType type, const std::string & method) const
+	{
+		bool matches = element.GetElementType() == type || (type == String && element.GetElementType() == UTF8) || (type == Int && element.GetElementType() == Date);
+		if (!matches)
+			throw std::invalid_argument("EBMLStreamWriter::" + method + "(). " + element.GetElementName() + " is not of the type written by it.");
+	}
+
+	void EBMLStreamWriter::BeginMaster(const EBMLElement & element, size_t sizeLength, bool crc)
+	{
+		Check(element, Master, "BeginMaster");
+		if (sizeLength < 1 || sizeLength > 8)
+			throw std::invalid_argument("EBMLStreamWriter::BeginMaster(). The size of " + element.GetElementName() + " cannot be reserved at " + std::to_string(sizeLength) + " bytes, 1 to 8 are.");
+		OpenMaster master { element.GetElementName(), 0, sizeLength, 0, crc, 0, 0, {} };
+		master.sizePosition = WriteHeader(element, 0, sizeLength);
+		master.dataPosition = position;
+		if (crc)
+		{
+			uint8_t crcElement[6] = { (uint8_t) CRC32_ID, 0x84, 0, 0, 0, 0 }; // Filled in by EndMaster
+			Append(crcElement, sizeof(crcElement));
+			master.crcStart = position;
+			master.running = CRC::Calculate(NULL, 0, Table());
+		}
+		masters.push_back(master);
+	}
+
+	void EBMLStreamWriter::EndMaster()
+	{
+		if (masters.empty())
+			throw std::logic_error("EBMLStreamWriter::EndMaster(). No master element is open.");
+		OpenMaster master = masters.back();
+		masters.pop_back();
+
+		if (master.crc)
+		{
+			uint32_t crc = master.running;
+			size_t length = position - master.crcStart;
+			for (auto & correction : master.corrections)
+				crc ^= ShiftThroughZeros(correction.crc, length - correction.end);
+			uint8_t before[4] = { 0, 0, 0, 0 }, after[4];
+			for (size_t i = 0; i < 4; i++)
+				after[i] = (uint8_t) (crc >> (8 * i)); // Little endian, as matroska stores it
+			Patch(master.crcStart - 4, before, after, 4);
+		}
+
+		uint64_t dataSize = position - master.dataPosition;
+		if (dataSize >= (uint64_t(1) << (7 * master.sizeLength)) - 1)
+			throw std::runtime_error("EBMLStreamWriter::EndMaster(). " + master.name + " holds " + std::to_string(dataSize) + " bytes, more than its " + std::to_string(master.sizeLength) + " byte size field can.");
+		uint8_t before[8], after[8];
+		EncodeSize(0, master.sizeLength, before);
+		EncodeSize(dataSize, master.sizeLength, after);
+		Patch(master.sizePosition, before, after, master.sizeLength);
+	}
+
+	void EBMLStreamWriter::WriteUint(const EBMLElement & element, uint64_t value)
+	{
+		Check(element, Uint, "WriteUint");
+		uint8_t data[8];
+		size_t length = 1;
+		while (length < 8 && (value >> (8 * length)))
+			length++;
+		for (size_t i = 0; i < length; i++)
+			data[length - 1 - i] = (uint8_t) (value >> (8 * i));
+		WriteHeader(element, length);
+		Append(data, length);
+	}
+
+	void EBMLStreamWriter::WriteInt(const EBMLElement & element, int64_t value)
+	{
+		Check(element, Int, "WriteInt");
+		uint8_t data[8];
+		size_t length = element.GetElementType() == Date ? 8 : 1;
+		while (length < 8 && (value < -(int64_t(1) << (8 * length - 1)) || value >= (int64_t(1) << (8 * length - 1))))
+			length++;
+		for (size_t i = 0; i < length; i++)
+			data[length - 1 - i] = (uint8_t) ((uint64_t) value >> (8 * i));
+		WriteHeader(element, length);
+		Append(data, length);
+	}
+
+	void EBMLStreamWriter::WriteFloat(const EBMLElement & element, double value)
+	{
+		Check(element, Float, "WriteFloat");
+		uint64_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		uint8_t data[8];
+		for (size_t i = 0; i < 8; i++)
+			data[7 - i] = (uint8_t) (bits >> (8 * i));
+		WriteHeader(element, 8);
+		Append(data, 8);
+	}
+
+	void EBMLStreamWriter::WriteString(const EBMLElement & element, const std::string & value)
+	{
+		Check(element, String, "WriteString");
+		WriteHeader(element, value.size());
+		Append((const uint8_t *) value.data(), value.size());
+	}
+
+	void EBMLStreamWriter::WriteBinary(const EBMLElement & element, const uint8_t * data, size_t length)
+	{
+		Check(element, Binary, "WriteBinary");
+		WriteHeader(element, length);
+		Append(data, length);
+	}
+
+	uint64_t EBMLStreamWriter::WriteBinary(const EBMLElement & element, int source, uint64_t length)
+	{
+		Check(element, Binary, "WriteBinary");
+		bool unknown = length == UnknownLength;
+		size_t sizePosition = WriteHeader(element, unknown ? 0 : length, unknown ? 8 : 0);
+		size_t dataPosition = position;
+		std::vector<uint8_t> chunk(std::min<uint64_t>(unknown ? bufferCapacity : length, bufferCapacity));
+		uint64_t copied = 0;
+		while (copied < length && !chunk.empty())
+		{
+			ssize_t count = read(source, chunk.data(), std::min<uint64_t>(chunk.size(), length - copied));
+			if (count < 0 && errno == EINTR)
+				continue;
+			if (count < 0)
+				throw std::runtime_error("EBMLStreamWriter::WriteBinary(). Reading the data of " + element.GetElementName() + " failed: " + strerror(errno));
+			if (count == 0)
+				break;
+			Append(chunk.data(), count);
+			copied += count;
+		}
+		if (!unknown && copied < length)
+			throw std::runtime_error("EBMLStreamWriter::WriteBinary(). The source of " + element.GetElementName() + " ended after " + std::to_string(copied) + " of " + std::to_string(length) + " bytes.");
+		if (unknown)
+		{
+			uint8_t before[8], after[8];
+			EncodeSize(0, 8, before);
+			EncodeSize(position - dataPosition, 8, after);
+			Patch(sizePosition, before, after, 8);
+		}
+		return copied;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,140 @@
+#include <EBMLTools/EBMLTrackReader.hpp>
+#include <EBMLTools/EBMLTypedElements.hpp>
+
+#include <stdexcept>
+
+namespace EBMLTools
+{
+	EBMLTrackReader::EBMLTrackReader(EBMLReader & reader, const std::vector<uint64_t> & tracks) : reader(reader), tracks(tracks.begin(), tracks.end())
+	{
+		auto info = reader.FastSearch(EBMLElement::Find("Info"));
+		if (info.size() > 0)
+			timecodeScale = SegmentInfo::Decode(info.at(0)).timecodeScale;
+		auto tracksElement = reader.FastSearch(EBMLElement::Find("Tracks"));
+		if (tracksElement.size() == 0)
+			throw std::runtime_error("EBMLTrackReader::EBMLTrackReader(). " + reader.GetFilename() + " has no Tracks element.");
+		for (auto & track : TrackEntry::DecodeAll(tracksElement.at(0)))
+			defaultDurations[track.trackNumber] = track.defaultDuration;
+
+		segment.reset(new EBMLReadElement(reader.GetRootElements(EBMLElement::Find("Segment")).at(0)));
+		segmentEnd = segment->GetElementPosition() + segment->GetElementByteLength();
+		position = reader.GetSegmentDataPosition();
+	}
+
+	EBMLTrackReader::~EBMLTrackReader() { CloseCluster(); }
+
+	bool EBMLTrackReader::Selected(uint64_t track) const { return tracks.empty() || tracks.count(track) > 0; }
+
+	void EBMLTrackReader::CloseCluster()
+	{
+		if (cluster && !clusterCached)
+			reader.parentStructure.erase(cluster->GetElementPosition());
+		cluster.reset();
+	}
+
+	bool EBMLTrackReader::NextBlock()
+	{
+		while (true)
+		{
+			if (!cluster)
+			{
+				if (position >= segmentEnd || position >= reader.fileSize)
+					return false;
+				reader.SetReadPosition(position);
+				bool cached = reader.parentStructure.count(position) > 0;
+				EBMLReadElement element = reader.ReadElement(*segment);
+				if (element.GetElementName() == "Cluster")
+				{
+					cluster.reset(new EBMLReadElement(element));
+					clusterCached = cached;
+					clusterEnd = position + element.GetElementByteLength();
+					clusterTimecode = 0;
+					position += element.GetElementIdByteLength() + element.GetElementDataSizeByteLength();
+				}
+				else
+				{
+					if (!cached)
+						reader.parentStructure.erase(position);
+					position += element.GetElementByteLength();
+				}
+				continue;
+			}
+			if (position >= clusterEnd)
+			{
+				CloseCluster();
+				continue;
+			}
+
+			size_t elementPosition = position;
+			reader.SetReadPosition(elementPosition);
+			bool cached = reader.parentStructure.count(elementPosition) > 0;
+			EBMLReadElement element = reader.ReadElement(*cluster);
+			position = elementPosition + element.GetElementByteLength();
+
+			if (element.GetElementName() == "Timecode")
+				clusterTimecode = element.GetUintData();
+			else if (element.GetElementName() == "SimpleBlock")
+			{
+				if (!Selected(reader.ReadBlockHeader(element).GetTrackNumber()))
+					continue;
+				reader.ReadBlock(element, block, buffer);
+				blockPosition = elementPosition;
+				blockKeyframe = block.IsKeyframe();
+				frameIndex = 0;
+				return true;
+			}
+			else if (element.GetElementName() == "BlockGroup")
+			{
+				std::unique_ptr<EBMLReadElement> blockElement;
+				bool referenced = false;
+				for (auto & child : element.ChildRange())
+				{
+					if (child.GetElementName() == "Block")
+						blockElement.reset(new EBMLReadElement(child));
+					else if (child.GetElementName() == "ReferenceBlock")
+						referenced = true;
+				}
+				if (!cached)
+					reader.parentStructure.erase(elementPosition);
+				if (!blockElement || !Selected(reader.ReadBlockHeader(*blockElement).GetTrackNumber()))
+					continue;
+				reader.ReadBlock(*blockElement, block, buffer);
+				blockPosition = elementPosition;
+				blockKeyframe = !referenced;
+				frameIndex = 0;
+				return true;
+			}
+			else if (element.GetElementType() == Master && !cached)
+				reader.parentStructure.erase(elementPosition);
+		}
+	}
+
+	bool EBMLTrackReader::Next(Frame & frame)
+	{
+		size_t cachedPosition = reader.GetReadPosition();
+		bool found = frameIndex < block.Frames().size() || NextBlock();
+		reader.SetReadPosition(cachedPosition);
+		if (!found)
+			return false;
+
+		const EBMLBlock::Frame & blockFrame = block.Frames()[frameIndex];
+		int64_t timestamp = (int64_t) clusterTimecode + block.GetTimecode();
+		if (frameIndex > 0)
+			timestamp += frameIndex * defaultDurations[block.GetTrackNumber()] / timecodeScale;
+		frame = Frame { block.GetTrackNumber(), timestamp, blockKeyframe, blockFrame.data, blockFrame.size, blockPosition };
+		frameIndex++;
+		return true;
+	}
+
+	void EBMLTrackReader::Seek(size_t clusterPosition)
+	{
+		if (clusterPosition < reader.GetSegmentDataPosition() || clusterPosition >= segmentEnd)
+			throw std::out_of_range("EBMLTrackReader::Seek(). Position " + std::to_string(clusterPosition) + " is not inside the segment.");
+		CloseCluster();
+		block = EBMLBlock();
+		frameIndex = 0;
+		position = clusterPosition;
+	}
+
+	uint64_t EBMLTrackReader::GetTimecodeScale() const { return timecodeScale; }
+}
\ No newline at end of file
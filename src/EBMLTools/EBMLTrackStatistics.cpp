@@ -0,0 +1,112 @@
+#include <EBMLTools/EBMLTrackStatistics.hpp>
+#include <EBMLTools/EBMLClusterScanner.hpp>
+#include <EBMLTools/EBMLTypedElements.hpp>
+
+#include <algorithm>
+#include <limits>
+
+namespace EBMLTools
+{
+	namespace
+	{
+		struct Accumulator
+		{
+			uint64_t blocks = 0;
+			uint64_t packets = 0;
+			uint64_t keyframes = 0;
+			uint64_t bytes = 0;
+			int64_t first = std::numeric_limits<int64_t>::max();
+			int64_t last = std::numeric_limits<int64_t>::min();
+			std::map<int64_t, uint64_t> buckets; // Bucket index, bytes
+		};
+		typedef std::map<uint64_t, Accumulator> Partial;
+	}
+
+	EBMLTrackStatistics::EBMLTrackStatistics(EBMLReader & reader) : reader(reader)
+	{
+		auto info = reader.FastSearch(EBMLElement::Find("Info"));
+		if (info.size() > 0)
+			timecodeScale = SegmentInfo::Decode(info.at(0)).timecodeScale;
+		auto tracks = reader.FastSearch(EBMLElement::Find("Tracks"));
+		if (tracks.size() > 0)
+			for (auto & track : TrackEntry::DecodeAll(tracks.at(0)))
+				defaultDurations[track.trackNumber] = track.defaultDuration;
+	}
+
+	void EBMLTrackStatistics::SetWindow(uint64_t nanoseconds) { window = std::max<uint64_t>(nanoseconds, 10); }
+	void EBMLTrackStatistics::SetThreads(size_t threads) { this->threads = threads; }
+
+	std::vector<EBMLTrackStatistics::Track> EBMLTrackStatistics::Compute()
+	{
+		const int64_t bucketsPerWindow = 10;
+		int64_t bucket = window / bucketsPerWindow;
+		int64_t scale = timecodeScale;
+
+		EBMLClusterScanner scanner(reader);
+		auto partials = scanner.Scan<Partial>([&](Partial & partial, const EBMLClusterScanner::Cluster & cluster) {
+			for (auto & block : cluster.blocks)
+			{
+				Accumulator & track = partial[block.block.GetTrackNumber()];
+				int64_t timestamp = ((int64_t) cluster.timecode + block.block.GetTimecode()) * scale;
+				uint64_t bytes = block.block.GetDataSize() - block.block.GetHeaderLength();
+				track.blocks++;
+				track.packets += block.block.GetFrameCount();
+				track.keyframes += block.keyframe;
+				track.bytes += bytes;
+				track.first = std::min(track.first, timestamp);
+				track.last = std::max(track.last, timestamp);
+				track.buckets[timestamp >= 0 ? timestamp / bucket : (timestamp - bucket + 1) / bucket] += bytes;
+			}
+		}, threads);
+
+		Partial merged;
+		for (auto & partial : partials)
+		{
+			for (auto & entry : partial)
+			{
+				Accumulator & track = merged[entry.first];
+				track.blocks += entry.second.blocks;
+				track.packets += entry.second.packets;
+				track.keyframes += entry.second.keyframes;
+				track.bytes += entry.second.bytes;
+				track.first = std::min(track.first, entry.second.first);
+				track.last = std::max(track.last, entry.second.last);
+				for (auto & counted : entry.second.buckets)
+					track.buckets[counted.first] += counted.second;
+			}
+		}
+
+		std::vector<Track> results;
+		for (auto & entry : merged)
+		{
+			Accumulator & track = entry.second;
+			int64_t duration = track.last - track.first + (int64_t) defaultDurations[entry.first];
+
+			// Sum of the buckets in [index, index + bucketsPerWindow) for every bucket a window can start at
+			uint64_t peak = 0, sum = 0;
+			auto windowStart = track.buckets.begin();
+			for (auto windowEnd = track.buckets.begin(); windowEnd != track.buckets.end(); windowEnd++)
+			{
+				sum += windowEnd->second;
+				while (windowEnd->first - windowStart->first >= bucketsPerWindow)
+					sum -= (windowStart++)->second;
+				peak = std::max(peak, sum);
+			}
+
+			double seconds = (double) std::min<int64_t>(duration, (int64_t) window) / 1e9;
+			Track result;
+			result.track = entry.first;
+			result.blocks = track.blocks;
+			result.packets = track.packets;
+			result.keyframes = track.keyframes;
+			result.bytes = track.bytes;
+			result.firstTimestamp = track.first;
+			result.lastTimestamp = track.last;
+			result.duration = duration;
+			result.averageBitrate = duration > 0 ? track.bytes * 8.0 / (duration / 1e9) : 0;
+			result.peakBitrate = seconds > 0 ? peak * 8.0 / seconds : 0;
+			results.push_back(result);
+		}
+		return results;
+	}
+}
\ No newline at end of file
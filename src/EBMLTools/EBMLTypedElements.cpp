@@ -0,0 +1,215 @@
+#include <EBMLTools/EBMLTypedElements.hpp>
+#include <EBMLTools/EBMLReader.hpp>
+
+#include <functional>
+#include <map>
+#include <stdexcept>
+
+namespace EBMLTools
+{
+	namespace
+	{
+		// Maps schema element ids to setters on T. Binding checks the member type against the
+		// element type in the schema table, so a mismatch fails when the table is built.
+		template <typename T>
+		class FieldTable
+		{
+			private:
+				typedef std::function<void(T &, const EBMLReadElement &)> Setter;
+				std::map<uint64_t, Setter> fields;
+
+				static const EBMLElement & Schema(const std::string & name, std::initializer_list<ElementType> types)
+				{
+					const EBMLElement & element = EBMLElement::Find(name);
+					for (auto type : types)
+						if (element.GetElementType() == type)
+							return element;
+					throw std::logic_error("FieldTable::Bind(). Member type does not match the schema type of " + name);
+				}
+			public:
+				FieldTable & Bind(const std::string & name, uint64_t T::* member)
+				{
+					fields[Schema(name, { Uint, Int, Date }).GetElementId()] = [member](T & t, const EBMLReadElement & e) { t.*member = e.GetUintData(); };
+					return *this;
+				}
+				FieldTable & Bind(const std::string & name, bool T::* member)
+				{
+					fields[Schema(name, { Uint }).GetElementId()] = [member](T & t, const EBMLReadElement & e) { t.*member = e.GetUintData() != 0; };
+					return *this;
+				}
+				FieldTable & Bind(const std::string & name, double T::* member)
+				{
+					fields[Schema(name, { Float }).GetElementId()] = [member](T & t, const EBMLReadElement & e) { t.*member = e.GetFloatData(); };
+					return *this;
+				}
+				FieldTable & Bind(const std::string & name, std::string T::* member)
+				{
+					fields[Schema(name, { String, UTF8 }).GetElementId()] = [member](T & t, const EBMLReadElement & e) { t.*member = e.GetStringData(); };
+					return *this;
+				}
+				FieldTable & Bind(const std::string & name, std::vector<uint64_t> T::* member)
+				{
+					fields[Schema(name, { Uint }).GetElementId()] = [member](T & t, const EBMLReadElement & e) { (t.*member).push_back(e.GetUintData()); };
+					return *this;
+				}
+				template <typename U>
+				FieldTable & Bind(const std::string & name, U T::* member, U (*decode)(const EBMLReadElement &))
+				{
+					fields[Schema(name, { Master }).GetElementId()] = [member, decode](T & t, const EBMLReadElement & e) { t.*member = decode(e); };
+					return *this;
+				}
+				template <typename U>
+				FieldTable & Bind(const std::string & name, std::vector<U> T::* member, U (*decode)(const EBMLReadElement &))
+				{
+					fields[Schema(name, { Master }).GetElementId()] = [member, decode](T & t, const EBMLReadElement & e) { (t.*member).push_back(decode(e)); };
+					return *this;
+				}
+				// Decode the children of a nested master straight into T (e.g. Targets into Tag)
+				FieldTable & Inline(const std::string & name, const FieldTable<T> & table)
+				{
+					fields[Schema(name, { Master }).GetElementId()] = [&table](T & t, const EBMLReadElement & e) { table.DecodeInto(t, e); };
+					return *this;
+				}
+
+				void DecodeInto(T & target, const EBMLReadElement & master) const
+				{
+					for (auto & child : master.ChildRange())
+					{
+						target.present.insert(child.GetElementId());
+						auto field = fields.find(child.GetElementId());
+						if (field != fields.end())
+							field->second(target, child);
+					}
+				}
+
+				T Decode(const EBMLReadElement & master, const std::string & expected) const
+				{
+					if (master.GetElementName() != expected)
+						throw std::invalid_argument("EBMLTypedElements, expected a " + expected + " element but got " + master.GetElementName());
+					T target;
+					target.position = master.GetElementPosition();
+					DecodeInto(target, master);
+					return target;
+				}
+		};
+
+		template <typename T>
+		std::vector<T> DecodeChildren(const EBMLReadElement & master, const std::string & parentName, const std::string & childName, T (*decode)(const EBMLReadElement &))
+		{
+			if (master.GetElementName() != parentName)
+				throw std::invalid_argument("EBMLTypedElements, expected a " + parentName + " element but got " + master.GetElementName());
+			std::vector<T> results;
+			for (auto & child : master.ChildRange(EBMLElement::Find(childName)))
+				results.push_back(decode(child));
+			return results;
+		}
+	}
+
+	bool EBMLTypedElement::Has(const EBMLElement & child) const { return present.count(child.GetElementId()) > 0; }
+	bool EBMLTypedElement::Has(const std::string & childName) const { return Has(EBMLElement::Find(childName)); }
+
+	tm * SegmentInfo::GetDateUTC() const
+	{
+		time_t epocheTime = dateUTC / 1000000000 + 978307200;
+		return std::gmtime(&epocheTime);
+	}
+
+	SegmentInfo SegmentInfo::Decode(const EBMLReadElement & info)
+	{
+		static const FieldTable<SegmentInfo> table = FieldTable<SegmentInfo>()
+			.Bind("TimecodeScale", &SegmentInfo::timecodeScale)
+			.Bind("Duration", &SegmentInfo::duration)
+			.Bind("DateUTC", &SegmentInfo::dateUTC)
+			.Bind("Title", &SegmentInfo::title)
+			.Bind("MuxingApp", &SegmentInfo::muxingApp)
+			.Bind("WritingApp", &SegmentInfo::writingApp);
+		return table.Decode(info, "Info");
+	}
+
+	AudioSettings AudioSettings::Decode(const EBMLReadElement & audio)
+	{
+		static const FieldTable<AudioSettings> table = FieldTable<AudioSettings>()
+			.Bind("SamplingFrequency", &AudioSettings::samplingFrequency)
+			.Bind("OutputSamplingFrequency", &AudioSettings::outputSamplingFrequency)
+			.Bind("Channels", &AudioSettings::channels)
+			.Bind("BitDepth", &AudioSettings::bitDepth);
+		return table.Decode(audio, "Audio");
+	}
+
+	VideoSettings VideoSettings::Decode(const EBMLReadElement & video)
+	{
+		static const FieldTable<VideoSettings> table = FieldTable<VideoSettings>()
+			.Bind("FlagInterlaced", &VideoSettings::flagInterlaced)
+			.Bind("StereoMode", &VideoSettings::stereoMode)
+			.Bind("PixelWidth", &VideoSettings::pixelWidth)
+			.Bind("PixelHeight", &VideoSettings::pixelHeight)
+			.Bind("DisplayWidth", &VideoSettings::displayWidth)
+			.Bind("DisplayHeight", &VideoSettings::displayHeight)
+			.Bind("DisplayUnit", &VideoSettings::displayUnit);
+		return table.Decode(video, "Video");
+	}
+
+	TrackEntry TrackEntry::Decode(const EBMLReadElement & trackEntry)
+	{
+		static const FieldTable<TrackEntry> table = FieldTable<TrackEntry>()
+			.Bind("TrackNumber", &TrackEntry::trackNumber)
+			.Bind("TrackUID", &TrackEntry::trackUID)
+			.Bind("TrackType", &TrackEntry::trackType)
+			.Bind("FlagEnabled", &TrackEntry::flagEnabled)
+			.Bind("FlagDefault", &TrackEntry::flagDefault)
+			.Bind("FlagForced", &TrackEntry::flagForced)
+			.Bind("FlagLacing", &TrackEntry::flagLacing)
+			.Bind("DefaultDuration", &TrackEntry::defaultDuration)
+			.Bind("Name", &TrackEntry::name)
+			.Bind("Language", &TrackEntry::language)
+			.Bind("CodecID", &TrackEntry::codecID)
+			.Bind("CodecName", &TrackEntry::codecName)
+			.Bind("CodecDelay", &TrackEntry::codecDelay)
+			.Bind("SeekPreRoll", &TrackEntry::seekPreRoll)
+			.Bind("Audio", &TrackEntry::audio, &AudioSettings::Decode)
+			.Bind("Video", &TrackEntry::video, &VideoSettings::Decode);
+		return table.Decode(trackEntry, "TrackEntry");
+	}
+
+	std::vector<TrackEntry> TrackEntry::DecodeAll(const EBMLReadElement & tracks)
+	{
+		return DecodeChildren(tracks, "Tracks", "TrackEntry", &TrackEntry::Decode);
+	}
+
+	SimpleTag SimpleTag::Decode(const EBMLReadElement & simpleTag)
+	{
+		static const FieldTable<SimpleTag> table = FieldTable<SimpleTag>()
+			.Bind("TagName", &SimpleTag::name)
+			.Bind("TagLanguage", &SimpleTag::language)
+			.Bind("TagDefault", &SimpleTag::isDefault)
+			.Bind("TagString", &SimpleTag::value)
+			.Bind("SimpleTag", &SimpleTag::children, &SimpleTag::Decode);
+		return table.Decode(simpleTag, "SimpleTag");
+	}
+
+	bool Tag::TargetsAll() const
+	{
+		return !Has("TargetTypeValue") && !Has("TargetType") && trackUIDs.empty()
+			&& editionUIDs.empty() && chapterUIDs.empty() && attachmentUIDs.empty();
+	}
+
+	Tag Tag::Decode(const EBMLReadElement & tag)
+	{
+		static const FieldTable<Tag> targets = FieldTable<Tag>()
+			.Bind("TargetTypeValue", &Tag::targetTypeValue)
+			.Bind("TargetType", &Tag::targetType)
+			.Bind("TagTrackUID", &Tag::trackUIDs)
+			.Bind("TagEditionUID", &Tag::editionUIDs)
+			.Bind("TagChapterUID", &Tag::chapterUIDs)
+			.Bind("TagAttachmentUID", &Tag::attachmentUIDs);
+		static const FieldTable<Tag> table = FieldTable<Tag>()
+			.Inline("Targets", targets)
+			.Bind("SimpleTag", &Tag::simpleTags, &SimpleTag::Decode);
+		return table.Decode(tag, "Tag");
+	}
+
+	std::vector<Tag> Tag::DecodeAll(const EBMLReadElement & tags)
+	{
+		return DecodeChildren(tags, "Tags", "Tag", &Tag::Decode);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,146 @@
+#include <EBMLTools/EBMLVoidReport.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <set>
+#include <thread>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+namespace EBMLTools
+{
+	namespace
+	{
+		class VoidCounter : public EBMLVisitor
+		{
+			private:
+				EBMLVoidReport::Report & report;
+				bool scanClusters;
+				size_t depth = 0;
+				bool clusterSeen = false;
+			public:
+				VoidCounter(EBMLVoidReport::Report & report, bool scanClusters) : report(report), scanClusters(scanClusters) {}
+
+				VisitResult EnterMaster(const EBMLReadElement & element)
+				{
+					if (element.GetElementName() == "Cluster")
+					{
+						clusterSeen = true;
+						if (!scanClusters)
+							return VisitResult::SkipChildren;
+					}
+					depth++;
+					return VisitResult::Continue;
+				}
+				VisitResult ExitMaster(const EBMLReadElement & element)
+				{
+					depth--;
+					return VisitResult::Continue;
+				}
+				VisitResult Element(const EBMLReadElement & element)
+				{
+					if (element.GetElementName() != "Void")
+						return VisitResult::Continue;
+					size_t length = element.GetElementByteLength();
+					report.levels[depth].voids++;
+					report.levels[depth].bytes += length;
+					report.voids++;
+					report.bytes += length;
+					if (depth == 1 && !clusterSeen)
+					{
+						report.preClusterBytes += length;
+						report.largestPreClusterVoid = std::max(report.largestPreClusterVoid, length);
+					}
+					return VisitResult::Continue;
+				}
+		};
+
+		bool IsMatroska(const std::string & name)
+		{
+			size_t dot = name.rfind('.');
+			if (dot == std::string::npos)
+				return false;
+			std::string extension = name.substr(dot + 1);
+			std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+			return extension == "mkv" || extension == "mka" || extension == "mks" || extension == "mk3d" || extension == "webm";
+		}
+
+		// Symbolic links are followed, but every directory and file is visited once: a link back up the tree is no loop
+		void Collect(const std::string & directory, std::vector<std::string> & files, std::set<std::pair<dev_t, ino_t>> & visited)
+		{
+			DIR * dir = opendir(directory.c_str());
+			if (dir == NULL)
+				return;
+			while (dirent * entry = readdir(dir))
+			{
+				std::string name = entry->d_name;
+				if (name == "." || name == "..")
+					continue;
+				std::string path = directory + "/" + name;
+				struct stat status;
+				if (stat(path.c_str(), &status) != 0 || !visited.insert(std::make_pair(status.st_dev, status.st_ino)).second)
+					continue;
+				if (S_ISDIR(status.st_mode))
+					Collect(path, files, visited);
+				else if (S_ISREG(status.st_mode) && IsMatroska(name))
+					files.push_back(path);
+			}
+			closedir(dir);
+		}
+	}
+
+	EBMLVoidReport::EBMLVoidReport(const std::string & fileName) : fileName(fileName) {}
+
+	void EBMLVoidReport::SetScanClusters(bool scan) { scanClusters = scan; }
+
+	EBMLVoidReport::Report EBMLVoidReport::Compute()
+	{
+		Report report;
+		report.fileName = fileName;
+		report.clustersScanned = scanClusters;
+		EBMLReader reader(fileName);
+		report.fileSize = reader.Refresh();
+		VoidCounter counter(report, scanClusters);
+		reader.Walk(counter);
+		return report;
+	}
+
+	std::vector<EBMLVoidReport::Report> EBMLVoidReport::Tree(const std::string & directory, bool scanClusters, size_t threads)
+	{
+		std::vector<std::string> files;
+		std::set<std::pair<dev_t, ino_t>> visited;
+		struct stat status;
+		if (stat(directory.c_str(), &status) == 0)
+			visited.insert(std::make_pair(status.st_dev, status.st_ino));
+		Collect(directory, files, visited);
+		std::sort(files.begin(), files.end());
+
+		if (threads == 0)
+			threads = std::max(1u, std::thread::hardware_concurrency());
+		std::vector<Report> reports(files.size());
+		std::atomic<size_t> next(0);
+		std::vector<std::thread> workers;
+		for (size_t i = 0; i < std::min(threads, files.size()); i++)
+			workers.push_back(std::thread([&]() {
+				for (size_t index; (index = next++) < files.size(); )
+				{
+					try
+					{
+						EBMLVoidReport single(files[index]);
+						single.SetScanClusters(scanClusters);
+						reports[index] = single.Compute();
+					}
+					catch (std::exception & ex)
+					{
+						reports[index].fileName = files[index];
+						reports[index].error = ex.what();
+					}
+				}
+			}));
+		for (auto & worker : workers)
+			worker.join();
+		return reports;
+	}
+}
\ No newline at end of file
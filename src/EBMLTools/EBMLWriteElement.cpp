@@ -379,17 +379,18 @@ namespace EBMLTools
 			dataSize = 4;
 			data = new uint8_t [dataSize];
 			FloatUnion _float;
-			_float.number = dataSize;
+			_float.number = value;
 			for (size_t i = 0; i < dataSize; i++)
-				data[i] = _float.buf[i];
+				data[dataSize - 1 - i] = _float.buf[i]; // Big endian, as read by GetFloatData
 		} else {
 			dataSize = 8;
 			data = new uint8_t [dataSize];
 			DoubleUnion _double;
-			_double.number = dataSize;
+			_double.number = value;
 			for (size_t i = 0; i < dataSize; i++)
-				data[i] = _double.buf[i];
+				data[dataSize - 1 - i] = _double.buf[i];
 		}
+		dataSizeByteLength = DetermineByteLengthOfValue(dataSize);
 	}
 
 	void EBMLWriteElement::SetDateData(tm * value)
@@ -1,13 +1,32 @@
 #include <iostream>
 #include <iomanip>
+#include <limits>
+
+#include <sys/stat.h>
 
 #include <cxxopts.hpp>
+#include <EBMLTools/EBMLDurationEstimator.hpp>
+#include <EBMLTools/EBMLExtractor.hpp>
+#include <EBMLTools/EBMLFileUtilities.hpp>
+#include <EBMLTools/EBMLLayoutOptimizer.hpp>
 #include <EBMLTools/EBMLParser.hpp>
+#include <EBMLTools/EBMLSalvage.hpp>
+#include <EBMLTools/EBMLTrackStatistics.hpp>
+#include <EBMLTools/EBMLTypedElements.hpp>
+#include <EBMLTools/EBMLVoidReport.hpp>
 #include <TMDB/API.hpp>
 #include <web++.hpp>
 
 int searchEBML(EBMLTools::EBMLParser &ebmlParser, cxxopts::ParseResult &result);
 int displayInfo(EBMLTools::EBMLParser &ebmlParser, cxxopts::ParseResult &result);
+int generateCues(EBMLTools::EBMLParser &ebmlParser);
+int salvageFile(const std::string &fileName);
+int voidReport(cxxopts::ParseResult &result);
+int displayStats(EBMLTools::EBMLParser &ebmlParser);
+int writeDuration(EBMLTools::EBMLParser &ebmlParser);
+int extractRange(EBMLTools::EBMLParser &ebmlParser, cxxopts::ParseResult &result);
+int optimizeLayout(EBMLTools::EBMLParser &ebmlParser, cxxopts::ParseResult &result);
+int compactMetadata(EBMLTools::EBMLParser &ebmlParser);
 int FindMediaThenTag(TMDB::API &tmdbApi, EBMLTools::EBMLParser &ebmlParser, cxxopts::ParseResult &result);
 Json::Value searchForMovie(TMDB::API &tmdbApi);
 Json::Value searchForTVShow(TMDB::API &tmdbApi);
@@ -50,8 +69,23 @@ int main(int argc, char * argv[])
     options.add_options("EBML Parser")
         ("f,file", "Matroska file to parse (manditory)", cxxopts::value<std::string>())
         ("i,info", "Display information about matroska file")
-        ("search", "Search EBML elements and display all matches (case-sensitive)", cxxopts::value<std::string>())
+        ("search", "Search EBML elements by name or path and display all matches (case-sensitive), e.g. Tracks/TrackEntry[TrackType=2]", cxxopts::value<std::string>())
         ("show-children", "Display nested children when searching")
+        ("generate-cues", "Index the keyframes of the file and write (or rewrite) its Cues element")
+        ("stats", "Display per track packet, keyframe, byte and bitrate statistics (reads every block header)")
+        ("write-duration", "Estimate the duration from the last Cluster and write it to the Info element")
+        ("extract", "Write the Clusters between --from and --to to a new matroska file, without decoding them", cxxopts::value<std::string>())
+        ("from", "Start of the extracted range in seconds (starts at the Cluster before it)", cxxopts::value<double>()->default_value("0"))
+        ("to", "End of the extracted range in seconds (end of the file by default)", cxxopts::value<double>())
+        ("optimize-layout", "Rewrite the file with all metadata and Cues in front of the Clusters")
+        ("padding", "Bytes of Void reserved in front of the Clusters by --optimize-layout", cxxopts::value<size_t>()->default_value("4096"))
+        ("compact", "Gather the Void elements in front of the Clusters into one, moving as few bytes as possible")
+        ("snapshot", "Take a reflink snapshot before every edit and roll back to it on failure (btrfs, XFS; refused elsewhere)")
+        ("journal", "Commit every edit through a journal file, so a crash during it is replayed or dropped on the next open")
+        ("reserve", "Void reserved behind every element written, as bytes or a percentage of its size (e.g. 10%), so later edits stay in place", cxxopts::value<std::string>())
+        ("void-report", "Report the Void bytes of a file, or of every matroska file below a directory (in parallel), by level and in front of the Clusters", cxxopts::value<std::string>())
+        ("deep", "--void-report also counts the Voids inside Clusters (reads every block header)")
+        ("salvage", "Scan a damaged file for intact elements, report the damaged byte ranges and rebuild its SeekHead")
         ("p,port", "Http server port number for viewing/downloading attachments", cxxopts::value<uint32_t>()->default_value("5000"));
     options.add_options("TheMovieDB.org")
         ("t,tvid", "theMovieDB.org TV Show ID", cxxopts::value<uint32_t>())
@@ -68,13 +102,42 @@ int main(int argc, char * argv[])
             std::cout << options.help({ "Generic", "EBML Parser", "TheMovieDB.org" });
             return 0;
         }
+        else if (result["void-report"].count())
+            return voidReport(result);
         else if (result["file"].count())
         {
+            if (result["salvage"].count())
+                return salvageFile(result["file"].as<std::string>());
             EBMLTools::EBMLParser ebmlParser(result["file"].as<std::string>());
+            if (result["reserve"].count())
+            {
+                std::string reserve = result["reserve"].as<std::string>();
+                bool percent = !reserve.empty() && reserve.back() == '%';
+                std::string digits = percent ? reserve.substr(0, reserve.size() - 1) : reserve;
+                if (digits.empty() || digits.size() > 12 || digits.find_first_not_of("0123456789") != std::string::npos) // No sign, stoul would wrap a negative amount
+                    throw std::invalid_argument("--reserve takes a byte count or a percentage such as 10%, not: " + reserve);
+                ebmlParser.SetPadding(percent ? EBMLTools::EBMLParser::PaddingMode::Percent : EBMLTools::EBMLParser::PaddingMode::Bytes, std::stoul(digits));
+            }
+            if (result["snapshot"].count())
+                ebmlParser.SetSnapshots(true);
+            if (result["journal"].count())
+                ebmlParser.SetJournal(true);
             if (result["info"].count())
                 return displayInfo(ebmlParser, result);
             else if (result["search"].count())
                 return searchEBML(ebmlParser, result);
+            else if (result["generate-cues"].count())
+                return generateCues(ebmlParser);
+            else if (result["stats"].count())
+                return displayStats(ebmlParser);
+            else if (result["write-duration"].count())
+                return writeDuration(ebmlParser);
+            else if (result["extract"].count())
+                return extractRange(ebmlParser, result);
+            else if (result["optimize-layout"].count())
+                return optimizeLayout(ebmlParser, result);
+            else if (result["compact"].count())
+                return compactMetadata(ebmlParser);
             else
                 return FindMediaThenTag(tmdbApi, ebmlParser, result);
         }
@@ -100,61 +163,233 @@ int searchEBML(EBMLTools::EBMLParser &ebmlParser, cxxopts::ParseResult &result)
 {
     try
     {
-        auto query = EBMLTools::EBMLElement::Find(result["search"].as<std::string>());
-        auto fsResults = ebmlParser.FastSearch(query);
-        for (auto & fsr : fsResults)
-            std::cout << fsr.ToString(result["show-children"].as<bool>());
+        EBMLTools::EBMLQuery query(result["search"].as<std::string>());
+        auto qResults = ebmlParser.Query(query);
+        for (auto & qr : qResults)
+            std::cout << qr.ToString(result["show-children"].as<bool>());
         return 0;
     }
     catch (std::invalid_argument &ex)
     {
-        std::cerr << "The EBML element you searched for does not exist."
+        std::cerr << "The EBML element or path you searched for is not valid: " << ex.what()
                   << "\n\nRun with -h or --help for more information."
                   << std::endl;
         return 1;
     }
 }
 
+int generateCues(EBMLTools::EBMLParser &ebmlParser)
+{
+    auto index = ebmlParser.GenerateCues();
+    std::cout << "Wrote " << index.Size() << " cue points for " << index.GetTracks().size() << " track(s) to " << ebmlParser.GetFilename() << std::endl;
+    return 0;
+}
+
+int writeDuration(EBMLTools::EBMLParser &ebmlParser)
+{
+    auto estimate = EBMLTools::EBMLDurationEstimator(ebmlParser).Compute();
+    ebmlParser.WriteDuration(estimate.duration);
+    std::cout << "Wrote Duration " << std::fixed << std::setprecision(0) << estimate.duration << " (last Cluster at " << estimate.clusterPosition << ", found through "
+              << (estimate.source == EBMLTools::EBMLDurationEstimator::Source::Cues ? "Cues" : estimate.source == EBMLTools::EBMLDurationEstimator::Source::SeekHead ? "SeekHead" : "a scan of the file end")
+              << ") to " << ebmlParser.GetFilename() << std::endl;
+    return 0;
+}
+
+int extractRange(EBMLTools::EBMLParser &ebmlParser, cxxopts::ParseResult &result)
+{
+    uint64_t start = (uint64_t)(std::max(result["from"].as<double>(), 0.0) * 1e9);
+    uint64_t end = result["to"].count() ? (uint64_t)(std::max(result["to"].as<double>(), 0.0) * 1e9) : std::numeric_limits<uint64_t>::max();
+    if (end <= start)
+    {
+        std::cerr << "--to must be after --from" << std::endl;
+        return 1;
+    }
+    EBMLTools::EBMLExtractor extractor(ebmlParser);
+    auto extracted = extractor.Extract(result["extract"].as<std::string>(), start, end);
+    std::cout << "Wrote " << extracted.clusters << " clusters (Timecode " << extracted.firstTimecode << " to " << extracted.lastTimecode << ") and "
+              << extracted.cuePoints << " cue points to " << result["extract"].as<std::string>() << ", " << extracted.fileSize << " bytes, "
+              << extracted.bytesCopied << " copied " << (extracted.offloaded ? "with copy_file_range" : "through user space") << std::endl;
+    return 0;
+}
+
+int compactMetadata(EBMLTools::EBMLParser &ebmlParser)
+{
+    auto compacted = ebmlParser.CompactMetadata();
+    std::cout << "Gathered " << compacted.voids << " Void element(s) into one of " << compacted.freeBytes << " bytes, moved "
+              << compacted.movedBytes << " bytes of " << ebmlParser.GetFilename() << std::endl;
+    return 0;
+}
+
+int optimizeLayout(EBMLTools::EBMLParser &ebmlParser, cxxopts::ParseResult &result)
+{
+    // Written next to the file and renamed over it, so a failure leaves the original untouched
+    std::string temporary = ebmlParser.GetFilename() + ".optimize";
+    EBMLTools::EBMLLayoutOptimizer optimizer(ebmlParser);
+    optimizer.SetPadding(result["padding"].as<size_t>());
+    EBMLTools::EBMLLayoutOptimizer::Result optimized;
+    try
+    {
+        optimized = optimizer.Write(temporary);
+    }
+    catch (std::exception &)
+    {
+        std::remove(temporary.c_str());
+        throw;
+    }
+    if (std::rename(temporary.c_str(), ebmlParser.GetFilename().c_str()) != 0)
+    {
+        std::cerr << "Unable to replace " << ebmlParser.GetFilename() << " with " << temporary << std::endl;
+        return 1;
+    }
+    if (!EBMLTools::EBMLFileUtilities::SyncDirectory(ebmlParser.GetFilename()))
+    {
+        std::cerr << "Unable to sync the directory of " << ebmlParser.GetFilename() << ", the rename may not survive a crash" << std::endl;
+        return 1;
+    }
+    std::cout << "Rewrote " << ebmlParser.GetFilename() << ": " << optimized.metadataLength << " bytes of metadata in front of " << optimized.clusters << " clusters, "
+              << optimized.bytesCopied << " bytes moved in " << optimized.copies << " copies " << (optimized.offloaded ? "with copy_file_range" : "through user space") << std::endl;
+    return 0;
+}
+
+int displayStats(EBMLTools::EBMLParser &ebmlParser)
+{
+    EBMLTools::EBMLTrackStatistics statistics(ebmlParser);
+    auto tracks = statistics.Compute();
+    std::cout << "File: " << ebmlParser.GetFilename()
+              << "\nStatistics:" << std::string(16, ' ') << "Total Tracks: " << tracks.size() << std::fixed << std::setprecision(3);
+    for (auto & track : tracks)
+    {
+        std::cout << "\n  Track " << track.track << ":"
+                  << "\n\t" << std::setw(18) << std::left << "Packets: " << track.packets << " in " << track.blocks << " blocks"
+                  << "\n\t" << std::setw(18) << std::left << "Keyframes: " << track.keyframes
+                  << "\n\t" << std::setw(18) << std::left << "Bytes: " << track.bytes
+                  << "\n\t" << std::setw(18) << std::left << "First: " << track.firstTimestamp / 1e9 << " s"
+                  << "\n\t" << std::setw(18) << std::left << "Last: " << track.lastTimestamp / 1e9 << " s"
+                  << "\n\t" << std::setw(18) << std::left << "Duration: " << track.duration / 1e9 << " s"
+                  << "\n\t" << std::setw(18) << std::left << "Average Bitrate: " << track.averageBitrate / 1000 << " kbit/s"
+                  << "\n\t" << std::setw(18) << std::left << "Peak Bitrate: " << track.peakBitrate / 1000 << " kbit/s (1 s window)";
+    }
+    std::cout << std::endl;
+    return 0;
+}
+
+int voidReport(cxxopts::ParseResult &result)
+{
+    std::string path = result["void-report"].as<std::string>();
+    bool deep = result["deep"].as<bool>();
+    struct stat status;
+    std::vector<EBMLTools::EBMLVoidReport::Report> reports;
+    if (stat(path.c_str(), &status) == 0 && S_ISDIR(status.st_mode))
+        reports = EBMLTools::EBMLVoidReport::Tree(path, deep);
+    else
+    {
+        EBMLTools::EBMLVoidReport single(path);
+        single.SetScanClusters(deep);
+        reports.push_back(single.Compute());
+    }
+
+    // Most reclaimable first, those are the files --optimize-layout pays off for
+    std::stable_sort(reports.begin(), reports.end(), [](const EBMLTools::EBMLVoidReport::Report &a, const EBMLTools::EBMLVoidReport::Report &b) { return a.bytes > b.bytes; });
+    size_t files = 0, voids = 0, bytes = 0, preCluster = 0;
+    for (auto & report : reports)
+    {
+        std::cout << report.fileName;
+        if (!report.error.empty())
+        {
+            std::cout << "\n  Not read: " << report.error << std::endl;
+            continue;
+        }
+        std::cout << "\n  Reclaimable: " << report.bytes << " bytes in " << report.voids << " Voids (" << std::fixed << std::setprecision(2)
+                  << (report.fileSize ? report.bytes * 100.0 / report.fileSize : 0.0) << "% of " << report.fileSize << " bytes)"
+                  << "\n  Before the Clusters: " << report.preClusterBytes << " bytes, largest Void " << report.largestPreClusterVoid;
+        for (auto & level : report.levels)
+            std::cout << "\n  Level " << level.first << ": " << level.second.bytes << " bytes in " << level.second.voids << " Voids";
+        std::cout << std::endl;
+        files++;
+        voids += report.voids;
+        bytes += report.bytes;
+        preCluster += report.preClusterBytes;
+    }
+    std::cout << "Total: " << bytes << " bytes in " << voids << " Voids across " << files << " file(s), " << preCluster << " bytes before the Clusters" << (deep ? "" : " (Cluster contents not scanned)") << std::endl;
+    return 0;
+}
+
+int salvageFile(const std::string &fileName)
+{
+    EBMLTools::EBMLSalvage salvage(fileName);
+    auto report = salvage.Scan();
+    std::cout << "Segment data:" << std::string(11, ' ') << report.segmentDataPosition << " - " << report.segmentEnd;
+    if (report.truncated)
+        std::cout << " (truncated, the segment size points past the end of the file)";
+    std::cout << "\nIntact elements:" << std::string(7, ' ') << report.elements.size();
+    std::map<std::string, size_t> counts;
+    for (auto & element : report.elements)
+        counts[EBMLTools::EBMLElement::Find(element.id).GetElementName()]++;
+    for (auto & count : counts)
+        std::cout << "\n  " << std::left << std::setw(21) << count.first << count.second;
+    std::cout << "\nDamaged ranges:" << std::string(8, ' ') << report.damaged.size();
+    for (auto & range : report.damaged)
+        std::cout << "\n  " << range.start << " - " << range.end << " (" << range.end - range.start << " bytes)";
+    if (report.damaged.empty())
+        std::cout << "\nNo damage found, the SeekHead is left as it is" << std::endl;
+    else if (salvage.RebuildSeekHead(report))
+        std::cout << "\nSeekHead rebuilt at " << report.segmentDataPosition << std::endl;
+    else
+        std::cout << "\nSeekHead not rebuilt, it does not fit in front of the first intact element" << std::endl;
+    return 0;
+}
+
 int displayInfo(EBMLTools::EBMLParser &ebmlParser, cxxopts::ParseResult &result)
 {
     
-    auto info = ebmlParser.FastSearch(EBMLTools::EBMLElement::Find("Info")).at(0);
-    float duration = info.Children(EBMLTools::EBMLElement::Find("Duration")).at(0).GetFloatData();
-    auto dateUtc = info.Children(EBMLTools::EBMLElement::Find("DateUTC")).at(0).GetDateData();
-    std::string muxingApp = info.Children(EBMLTools::EBMLElement::Find("MuxingApp")).at(0).GetStringData();
-    std::string writingApp = info.Children(EBMLTools::EBMLElement::Find("WritingApp")).at(0).GetStringData();
+    auto info = EBMLTools::SegmentInfo::Decode(ebmlParser.FastSearch(EBMLTools::EBMLElement::Find("Info")).at(0));
+    bool estimated = false;
+    if (!info.Has("Duration"))
+    {
+        try
+        {
+            info.duration = EBMLTools::EBMLDurationEstimator(ebmlParser).Compute().duration;
+            estimated = true;
+        }
+        catch (std::runtime_error &) {} // No Cluster to estimate from
+    }
+    float duration = info.duration * info.timecodeScale / 1000000;
     std::stringstream durationStr;
-    if ((int)duration / 1000 / 60 / 60 > 0)
-        durationStr << int(duration / 1000 / 60 / 60) << " hours ";
-    if ((int)duration / 1000 / 60 > 0)
-        durationStr << int((int)duration / 1000 / 60 % 60) << " minutes ";
-    durationStr << int((int)duration / 1000 % 60) << " seconds";
+    if (!info.Has("Duration") && !estimated)
+        durationStr << "Unknown";
+    else
+    {
+        if ((int)duration / 1000 / 60 / 60 > 0)
+            durationStr << int(duration / 1000 / 60 / 60) << " hours ";
+        if ((int)duration / 1000 / 60 > 0)
+            durationStr << int((int)duration / 1000 / 60 % 60) << " minutes ";
+        durationStr << int((int)duration / 1000 % 60) << " seconds";
+        if (estimated)
+            durationStr << " (estimated)";
+    }
+    std::stringstream dateStr;
+    if (info.Has("DateUTC"))
+        dateStr << std::put_time(info.GetDateUTC(), "%Y-%m-%d %H:%M:%S");
+    else
+        dateStr << "Unknown";
 
-    auto tracks = ebmlParser.FastSearch(EBMLTools::EBMLElement::Find("Tracks")).at(0);
+    auto tracks = EBMLTools::TrackEntry::DecodeAll(ebmlParser.FastSearch(EBMLTools::EBMLElement::Find("Tracks")).at(0));
 
     std::cout << "File: " << ebmlParser.GetFilename()
               << "\nInfo:"
               << "\n\t" << std::setw(18) << std::left << "Duration: " << durationStr.str()
-              << "\n\t" << std::setw(18) << std::left << "Date: " << std::put_time(dateUtc, "%Y-%m-%d %H:%M:%S")
-              << "\n\t" << std::setw(18) << std::left << "WritingApp: " << writingApp
-              << "\n\t" << std::setw(18) << std::left << "MuxingApp: " << muxingApp
+              << "\n\t" << std::setw(18) << std::left << "Date: " << dateStr.str()
+              << "\n\t" << std::setw(18) << std::left << "WritingApp: " << info.writingApp
+              << "\n\t" << std::setw(18) << std::left << "MuxingApp: " << info.muxingApp
               << std::endl;
-    std::cout << "\nTracks:" << std::string(20,' ') << "Total Tracks: " << tracks.Children().size();
+    std::cout << "\nTracks:" << std::string(20,' ') << "Total Tracks: " << tracks.size();
 
-    for (auto & trackentry : tracks.Children())
+    for (auto & track : tracks)
     {
-        if (trackentry.GetElementId() == 0xEC)
-            continue;
-        int trackNum = trackentry.Children(EBMLTools::EBMLElement::Find("TrackNumber")).at(0).GetUintData();
-        int trackType = trackentry.Children(EBMLTools::EBMLElement::Find("TrackType")).at(0).GetUintData();
-        std::string codec = trackentry.Children(EBMLTools::EBMLElement::Find("CodecID")).at(0).GetStringData();
-        auto lang = trackentry.Children(EBMLTools::EBMLElement::Find("Language"));
-        auto name = trackentry.Children(EBMLTools::EBMLElement::Find("Name"));
-        
         std::cout << "\n  Track Entry:"
-                  << "\n\t" << std::setw(18) << "Track Number: " << trackNum
+                  << "\n\t" << std::setw(18) << "Track Number: " << track.trackNumber
                   << "\n\t" << std::setw(18) << "Track Type: ";
-        switch (trackType)
+        switch (track.trackType)
         {
             case 1:
                 std::cout << "Video";
@@ -169,29 +404,23 @@ int displayInfo(EBMLTools::EBMLParser &ebmlParser, cxxopts::ParseResult &result)
                 std::cout << "Unknown";
                 break;
         }
-        std::cout << "\n\t" << std::setw(18) << "Codec: " << codec;
-        if (name.size() > 0)
-            std::cout << "\n\t" << std::setw(18) << "Name: " << name.at(0).GetStringData();
-        if (lang.size() > 0)
-            std::cout << "\n\t" << std::setw(18) << "Language: " << lang.at(0).GetStringData();
+        std::cout << "\n\t" << std::setw(18) << "Codec: " << track.codecID;
+        if (track.Has("Name"))
+            std::cout << "\n\t" << std::setw(18) << "Name: " << track.name;
+        if (track.Has("Language"))
+            std::cout << "\n\t" << std::setw(18) << "Language: " << track.language;
         
-        auto audio = trackentry.Children(EBMLTools::EBMLElement::Find("Audio"));
-        auto video = trackentry.Children(EBMLTools::EBMLElement::Find("Video"));
-        if (audio.size() > 0)
+        if (track.Has("Audio"))
         {
-            float samplingFrequency = audio.at(0).Children(EBMLTools::EBMLElement::Find("SamplingFrequency")).at(0).GetFloatData();
-            int channels = audio.at(0).Children(EBMLTools::EBMLElement::Find("Channels")).at(0).GetUintData();
             std::cout << "\n\t" << std::setw(18) << "Audio: "
-                      << "\n\t\t" << std::setw(18) << "Frequency: " << samplingFrequency
-                      << "\n\t\t" << std::setw(18) << "Channels: " << channels;
+                      << "\n\t\t" << std::setw(18) << "Frequency: " << (float)track.audio.samplingFrequency
+                      << "\n\t\t" << std::setw(18) << "Channels: " << track.audio.channels;
         }
-        if (video.size() > 0)
+        if (track.Has("Video"))
         {
-            int width = video.at(0).Children(EBMLTools::EBMLElement::Find("PixelWidth")).at(0).GetUintData();
-            int height = video.at(0).Children(EBMLTools::EBMLElement::Find("PixelHeight")).at(0).GetUintData();
             std::cout << "\n\t" << "Video: "
-                      << "\n\t\t" << std::setw(18) << "PixelWidth: " << width
-                      << "\n\t\t" << std::setw(18) << "PixelHeight: " << height;
+                      << "\n\t\t" << std::setw(18) << "PixelWidth: " << track.video.pixelWidth
+                      << "\n\t\t" << std::setw(18) << "PixelHeight: " << track.video.pixelHeight;
         }
     }
     std::cout << std::endl;
@@ -200,31 +429,18 @@ int displayInfo(EBMLTools::EBMLParser &ebmlParser, cxxopts::ParseResult &result)
     if (tags.size() > 0)
     {
         std::cout << "\nTags:";
-        for (auto &tag : tags.at(0).Children())
+        for (auto &tag : EBMLTools::Tag::DecodeAll(tags.at(0)))
         {
-            auto targets = tag.Children(EBMLTools::EBMLElement::Find("Targets")).at(0);
-            if (targets.GetElementDataSize() == 0)
+            if (tag.TargetsAll())
                 std::cout << "\n  Tag:" << std::string(20, ' ') << "Targets: All";
             else
-            {
-                auto targetValue = targets.Children(EBMLTools::EBMLElement::Find("TargetTypeValue"));
-                auto targetType = targets.Children(EBMLTools::EBMLElement::Find("TargetType"));
-                std::cout << "\n  Tag:" << std::string(20, ' ') << "Targets: " << ((targetType.size() > 0) ? targetType.at(0).GetStringData() : "") << " (" << targetValue.at(0).GetUintData() << ")";
-            }
-            auto simpleTags = tag.Children(EBMLTools::EBMLElement::Find("SimpleTag"));
+                std::cout << "\n  Tag:" << std::string(20, ' ') << "Targets: " << tag.targetType << " (" << tag.targetTypeValue << ")";
 
-            for (auto & st : simpleTags)
+            for (auto & st : tag.simpleTags)
             {
-                auto children = st.Children();
-                for (auto & child : children)
-                {
-                    if (child.GetElementName() == "TagName")
-                        std::cout << "\n\t" << child.GetStringData() << ": ";
-                    else if (child.GetElementName() == "TagString")
-                        std::cout << child.GetStringData();
-                    else if (child.GetElementName() == "SimpleTag")
-                        std::cout << "\n\t  " << child.Children(EBMLTools::EBMLElement::Find("TagName")).at(0).GetStringData() << ": " << child.Children(EBMLTools::EBMLElement::Find("TagString")).at(0).GetStringData();
-                }
+                std::cout << "\n\t" << st.name << ": " << st.value;
+                for (auto & child : st.children)
+                    std::cout << "\n\t  " << child.name << ": " << child.value;
             }
         }
     }
@@ -869,22 +1085,32 @@ void WriteTags(EBMLTools::EBMLParser &ebmlParser, std::unique_ptr<EBMLTools::EBM
     auto existingTags = ebmlParser.FastSearch(EBMLTools::EBMLElement::Find("Tags"));
     auto existingAttachments = ebmlParser.FastSearch(EBMLTools::EBMLElement::Find("Attachments"));
 
+    size_t unchanged = 0;
     std::cout << "Writing Tags Element to file..."
               << std::endl;
-    if (existingTags.size() > 0)
-        ebmlParser.UpdateElement(existingTags[0], *Tags);
-    else
+    if (existingTags.size() > 0 && ebmlParser.UpdateElement(existingTags[0], *Tags) == EBMLTools::EBMLParser::UpdateResult::Unchanged)
+    {
+        std::cout << "Tags unchanged, nothing written" << std::endl;
+        unchanged++;
+    }
+    else if (existingTags.size() == 0)
         ebmlParser.AddElement(*Tags);
 
     std::cout << "Writing Attachments Element to file..."
               << std::endl;
-    if (existingAttachments.size() > 0)
-        ebmlParser.UpdateElement(existingAttachments[0], *Attachments);
-    else
+    if (existingAttachments.size() > 0 && ebmlParser.UpdateElement(existingAttachments[0], *Attachments) == EBMLTools::EBMLParser::UpdateResult::Unchanged)
+    {
+        std::cout << "Attachments unchanged, nothing written" << std::endl;
+        unchanged++;
+    }
+    else if (existingAttachments.size() == 0)
         ebmlParser.AddElement(*Attachments);
 
-    std::cout << "Mastroka file has been successfully modified..."
-              << std::endl;
+    if (unchanged == 2)
+        std::cout << "Mastroka file unchanged" << std::endl;
+    else
+        std::cout << "Mastroka file has been successfully modified..."
+                  << std::endl;
 }
 
 void WriteMovieTags(Json::Value &movie, EBMLTools::EBMLParser &ebmlParser)
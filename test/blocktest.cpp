@@ -0,0 +1,124 @@
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <EBMLTools/EBMLBlock.hpp>
+
+using namespace EBMLTools;
+using namespace std;
+
+struct Case
+{
+	string name;
+	vector<uint8_t> header;		// Track number, timecode, flags and the lace header
+	size_t payload;				// Frame bytes appended behind the header
+	vector<size_t> frames;		// Expected frame sizes, empty when the block must be rejected
+};
+
+// EBML lace header of 31 eight byte sizes that add up to 2^64 + 2: their sum wraps to 2, which fits the block. The sizes
+// grow by the largest difference an eight byte vint holds, the last five close the gap to 2^64 + 2
+vector<uint8_t> WrappingEBMLLace()
+{
+	const uint64_t bias = (uint64_t(1) << 55) - 1;
+	vector<uint64_t> sizes = { (uint64_t(1) << 56) - 2 };
+	for (size_t i = 1; i < 26; i++)
+		sizes.push_back(sizes.back() + bias);
+	uint64_t remaining = 2;
+	for (uint64_t frameSize : sizes)
+		remaining -= frameSize;
+	sizes.insert(sizes.end(), 4, remaining / 5);
+	sizes.push_back(remaining - remaining / 5 * 4);
+
+	vector<uint8_t> header = { 0x81, 0x00, 0x00, 0x06, (uint8_t) sizes.size() };
+	for (size_t i = 0; i < sizes.size(); i++)
+	{
+		uint64_t value = i == 0 ? sizes[0] : sizes[i] - sizes[i - 1] + bias;
+		header.push_back(0x01);
+		for (int shift = 48; shift >= 0; shift -= 8)
+			header.push_back((uint8_t) (value >> shift));
+	}
+	return header;
+}
+
+vector<Case> Cases()
+{
+	return {
+		{ "no lacing", { 0x81, 0x00, 0x0A, 0x80 }, 3, { 3 } },
+		{ "no lacing, empty frame", { 0x81, 0x00, 0x00, 0x00 }, 0, { 0 } },
+		{ "two byte track number", { 0x40, 0x85, 0xFF, 0xFE, 0x80 }, 1, { 1 } },
+		{ "xiph, one frame", { 0x81, 0x00, 0x00, 0x02, 0x00 }, 4, { 4 } },
+		{ "xiph, 255 continues", { 0x81, 0x00, 0x00, 0x02, 0x02, 0xFF, 0x01, 0x02 }, 261, { 256, 2, 3 } },
+		{ "xiph, exactly 255", { 0x81, 0x00, 0x00, 0x02, 0x01, 0xFF, 0x00 }, 256, { 255, 1 } },
+		{ "ebml, growing and shrinking", { 0x81, 0x00, 0x00, 0x06, 0x03, 0x83, 0xC0, 0x5F, 0xFD }, 3 + 4 + 2 + 5, { 3, 4, 2, 5 } },
+		{ "ebml, two frames", { 0x81, 0x00, 0x00, 0x06, 0x01, 0x40, 0x10 }, 16 + 1, { 16, 1 } },
+		{ "fixed", { 0x81, 0x00, 0x00, 0x04, 0x02 }, 9, { 3, 3, 3 } },
+		{ "fixed, empty frames", { 0x81, 0x00, 0x00, 0x04, 0x03 }, 0, { 0, 0, 0, 0 } },
+
+		{ "empty block", { }, 0, { } },
+		{ "zero track number byte", { 0x00, 0x00, 0x00, 0x00 }, 4, { } },
+		{ "truncated track number", { 0x40 }, 0, { } },
+		{ "truncated timecode", { 0x81, 0x00 }, 0, { } },
+		{ "laced without frame count", { 0x81, 0x00, 0x00, 0x02 }, 0, { } },
+		{ "xiph sizes past the end", { 0x81, 0x00, 0x00, 0x02, 0x01, 0xFF, 0xFF }, 0, { } },
+		{ "xiph sizes exceed the block", { 0x81, 0x00, 0x00, 0x02, 0x02, 0x10, 0x05 }, 20, { } },
+		{ "xiph sizes exceed by one", { 0x81, 0x00, 0x00, 0x02, 0x01, 0x05 }, 4, { } },
+		{ "ebml size truncated", { 0x81, 0x00, 0x00, 0x06, 0x01, 0x40 }, 0, { } },
+		{ "ebml size zero byte", { 0x81, 0x00, 0x00, 0x06, 0x01, 0x00 }, 8, { } },
+		{ "ebml delta truncated", { 0x81, 0x00, 0x00, 0x06, 0x02, 0x82 }, 0, { } },
+		{ "ebml negative size", { 0x81, 0x00, 0x00, 0x06, 0x02, 0x82, 0x81 }, 8, { } },
+		{ "ebml sizes exceed the block", { 0x81, 0x00, 0x00, 0x06, 0x01, 0xFE }, 10, { } },
+		{ "ebml eight byte size", { 0x81, 0x00, 0x00, 0x06, 0x01, 0x01, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF }, 16, { } },
+		{ "ebml sizes wrap around", WrappingEBMLLace(), 8, { } },
+		{ "fixed does not divide", { 0x81, 0x00, 0x00, 0x04, 0x02 }, 4, { } },
+	};
+}
+
+int main()
+{
+	size_t failures = 0;
+	for (auto & test : Cases())
+	{
+		// Exactly sized heap copy, so a read past the block is caught by a sanitizer build
+		vector<uint8_t> bytes(test.header);
+		for (size_t i = 0; i < test.payload; i++)
+			bytes.push_back((uint8_t) i);
+		uint8_t * data = new uint8_t[bytes.size()];
+		copy(bytes.begin(), bytes.end(), data);
+
+		string result;
+		try
+		{
+			EBMLBlock block(data, bytes.size());
+			if (test.frames.empty())
+				result = "parsed, should have thrown";
+			else if (block.GetFrameCount() != test.frames.size() || block.Frames().size() != test.frames.size())
+				result = to_string(block.Frames().size()) + " frames instead of " + to_string(test.frames.size());
+			else
+			{
+				size_t offset = block.GetHeaderLength();
+				if (offset != test.header.size())
+					result = "header length " + to_string(offset) + " instead of " + to_string(test.header.size());
+				for (size_t i = 0; i < test.frames.size() && result.empty(); i++)
+				{
+					const EBMLBlock::Frame & frame = block.GetFrame(i);
+					if (frame.size != test.frames[i] || frame.offset != offset || frame.data != data + offset)
+						result = "frame " + to_string(i) + " is " + to_string(frame.size) + " bytes at " + to_string(frame.offset);
+					offset += frame.size;
+				}
+				if (result.empty() && offset != bytes.size())
+					result = "frames end at " + to_string(offset) + " of " + to_string(bytes.size());
+			}
+		}
+		catch (std::runtime_error & e)
+		{
+			if (!test.frames.empty())
+				result = string("threw ") + e.what();
+		}
+		delete[] data;
+
+		cout << (result.empty() ? "ok     " : "FAILED ") << test.name << (result.empty() ? "" : ": " + result) << std::endl;
+		failures += !result.empty();
+	}
+	cout << std::endl << failures << " failed." << std::endl;
+	return failures > 0;
+}
\ No newline at end of file
@@ -0,0 +1,134 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <unistd.h>
+#include <EBMLTools/EBMLFollower.hpp>
+
+using namespace EBMLTools;
+using namespace std;
+
+// ID bytes as stored, a 2 byte size (an 8 byte one of all ones for an unknown size) and the data
+vector<uint8_t> Element(uint32_t id, const vector<uint8_t> & data, bool unknownSize = false)
+{
+	vector<uint8_t> bytes;
+	for (int shift = 24; shift >= 0; shift -= 8)
+		if ((id >> shift) != 0)
+			bytes.push_back((uint8_t) (id >> shift));
+	if (unknownSize)
+		bytes.insert(bytes.end(), { 0x01, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF });
+	else
+		bytes.insert(bytes.end(), { (uint8_t) (0x40 | (data.size() >> 8)), (uint8_t) data.size() });
+	bytes.insert(bytes.end(), data.begin(), data.end());
+	return bytes;
+}
+
+vector<uint8_t> UintElement(uint32_t id, uint8_t value) { return Element(id, { value }); }
+
+vector<uint8_t> Concat(const vector<vector<uint8_t>> & parts)
+{
+	vector<uint8_t> bytes;
+	for (auto & part : parts)
+		bytes.insert(bytes.end(), part.begin(), part.end());
+	return bytes;
+}
+
+// A live recording: Segment and Clusters of unknown size, the Clusters with SimpleBlocks and BlockGroups of
+// several lengths, a Tags element behind them that ends the last one. start: the end of the Info, which the reader
+// needs to open the file
+vector<uint8_t> Recording(vector<EBMLFollower::Cluster> & clusters, size_t & start)
+{
+	vector<uint8_t> bytes = Element(0x1A45DFA3, Concat({ UintElement(0x4286, 1), UintElement(0x42F3, 8), Element(0x4282, { 'm', 'a', 't', 'r', 'o', 's', 'k', 'a' }) }));
+	bytes = Concat({ bytes, Element(0x18538067, { }, true) });
+	bytes = Concat({ bytes, Element(0x1549A966, UintElement(0x2AD7B1, 0x40)) });
+	start = bytes.size();
+	bytes = Concat({ bytes, Element(0x1654AE6B, Element(0xAE, Concat({ UintElement(0xD7, 1), UintElement(0x83, 1), Element(0x86, { 'V', '_', 'T', 'E', 'S', 'T' }) }))) });
+	for (uint8_t i = 0; i < 5; i++)
+	{
+		vector<uint8_t> cluster = UintElement(0xE7, i * 10);
+		for (uint8_t block = 0; block < 3; block++)
+		{
+			vector<uint8_t> data = { 0x81, 0x00, block, (uint8_t) (block == 0 ? 0x80 : 0x00) };
+			data.resize(4 + 20 * i + 7 * block, i);
+			cluster = Concat({ cluster, i % 2 == 0 ? Element(0xA3, data) : Element(0xA0, Element(0xA1, data)) });
+		}
+		clusters.push_back({ bytes.size(), 12 + cluster.size(), (uint64_t) i * 10 });
+		bytes = Concat({ bytes, Element(0x1F43B675, cluster, true) });
+	}
+	return Concat({ bytes, Element(0x1254C367, Element(0x7373, { })) });
+}
+
+// Every Cluster indexed so far is one of the expected, at its position with its full size and Timecode
+string Check(const vector<EBMLFollower::Cluster> & indexed, const vector<EBMLFollower::Cluster> & expected)
+{
+	if (indexed.size() > expected.size())
+		return to_string(indexed.size()) + " Clusters indexed of " + to_string(expected.size());
+	for (size_t i = 0; i < indexed.size(); i++)
+		if (indexed[i].position != expected[i].position || indexed[i].size != expected[i].size || indexed[i].timecode != expected[i].timecode)
+			return "Cluster " + to_string(i) + " indexed as " + to_string(indexed[i].size) + " bytes at " + to_string(indexed[i].position) + " with Timecode " + to_string(indexed[i].timecode);
+	return "";
+}
+
+int main()
+{
+	char directory[] = "/tmp/followertest.XXXXXX";
+	if (mkdtemp(directory) == NULL)
+	{
+		cout << "Unable to create a temporary directory." << std::endl;
+		return 1;
+	}
+	string file = string(directory) + "/live.mkv";
+	vector<EBMLFollower::Cluster> expected;
+	size_t start;
+	vector<uint8_t> recording = Recording(expected, start);
+
+	size_t failures = 0;
+	auto report = [&](const string & name, const string & result) {
+		cout << (result.empty() ? "ok     " : "FAILED ") << name << (result.empty() ? "" : ": " + result) << std::endl;
+		failures += !result.empty();
+	};
+
+	// The file grows by step bytes between updates, so every header and Cluster is seen cut off at some point
+	for (size_t step : { 1, 3, 7, 12, 100, 4096 })
+	{
+		string result;
+		try
+		{
+			ofstream(file, ios::binary).write((const char *) recording.data(), start);
+			EBMLReader reader(file);
+			EBMLFollower follower(reader);
+			size_t indexed = 0;
+			for (size_t written = start; written < recording.size() && result.empty(); )
+			{
+				size_t length = min(step, recording.size() - written);
+				ofstream(file, ios::binary | ios::app).write((const char *) recording.data() + written, length);
+				written += length;
+				indexed += follower.Update();
+				result = Check(follower.GetClusters(), expected);
+				if (result.empty() && follower.GetClusters().size() != indexed)
+					result = "Update() returned " + to_string(indexed) + " Clusters in total for " + to_string(follower.GetClusters().size());
+				if (result.empty() && written < expected.back().position + expected.back().size && indexed == expected.size())
+					result = "the last Cluster was indexed before the element behind it was written";
+			}
+			follower.Update(true);
+			if (result.empty())
+				result = Check(follower.GetClusters(), expected);
+			if (result.empty() && follower.GetClusters().size() != expected.size())
+				result = to_string(follower.GetClusters().size()) + " Clusters indexed of " + to_string(expected.size());
+			// The first SimpleBlock of the even Clusters and every BlockGroup of the odd ones
+			if (result.empty() && follower.GetCues().Size() != 9)
+				result = to_string(follower.GetCues().Size()) + " CuePoints for 9 keyframes";
+		}
+		catch (std::exception & e)
+		{
+			result = string("threw ") + e.what();
+		}
+		unlink(file.c_str());
+		report("file growing by " + to_string(step) + " bytes", result);
+	}
+
+	rmdir(directory);
+	cout << std::endl << failures << " failed." << std::endl;
+	return failures > 0;
+}
\ No newline at end of file
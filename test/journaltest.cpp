@@ -0,0 +1,182 @@
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <unistd.h>
+#include <CRC.hpp>
+#include <EBMLTools/EBMLJournal.hpp>
+
+using namespace EBMLTools;
+using namespace std;
+
+// Journals are built byte by byte from the documented layout, so the on-disk format is checked too
+struct Record
+{
+	uint8_t type;	// 0x01 data, 0x02 zeros
+	uint64_t position;
+	uint64_t length;
+	string data;
+};
+
+void PutUint(vector<uint8_t> & bytes, uint64_t value)
+{
+	for (int i = 7; i >= 0; i--)
+		bytes.push_back((uint8_t) (value >> (i * 8)));
+}
+
+vector<uint8_t> BuildJournal(const vector<Record> & records)
+{
+	vector<uint8_t> journal = { 'E', 'B', 'M', 'L', 'J', 'R', 'N', '1' };
+	for (auto & record : records)
+	{
+		journal.push_back(record.type);
+		PutUint(journal, record.position);
+		PutUint(journal, record.length);
+		journal.insert(journal.end(), record.data.begin(), record.data.end());
+	}
+	uint32_t crc = CRC::Calculate(journal.data(), journal.size(), CRC::CRC_32());
+	journal.push_back(0xFF);
+	PutUint(journal, records.size());
+	PutUint(journal, crc);
+	return journal;
+}
+
+void WriteFile(const string & path, const vector<uint8_t> & bytes)
+{
+	ofstream out(path, ios::binary | ios::trunc);
+	out.write((const char *) bytes.data(), bytes.size());
+}
+
+vector<uint8_t> ReadFile(const string & path)
+{
+	ifstream in(path, ios::binary);
+	return vector<uint8_t>(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+}
+
+int main()
+{
+	char directory[] = "/tmp/journaltest.XXXXXX";
+	if (mkdtemp(directory) == NULL)
+	{
+		cout << "Unable to create a temporary directory." << std::endl;
+		return 1;
+	}
+	string file = string(directory) + "/test.mkv";
+	string journal = file + ".journal";
+
+	const vector<uint8_t> original(64, 'a');
+	const vector<Record> records = {
+		{ 0x01, 10, 5, "HELLO" },
+		{ 0x02, 30, 6, "" },
+		{ 0x01, 62, 4, "WXYZ" },	// Extends the file
+	};
+	vector<uint8_t> applied(original);
+	applied.resize(66);
+	copy_n("HELLO", 5, applied.begin() + 10);
+	fill_n(applied.begin() + 30, 6, 0);
+	copy_n("WXYZ", 4, applied.begin() + 62);
+	const vector<uint8_t> committed = BuildJournal(records);
+
+	size_t failures = 0;
+	auto check = [&](const string & name, const vector<uint8_t> & journalBytes, bool replayed, const vector<uint8_t> & expected) {
+		WriteFile(file, original);
+		WriteFile(journal, journalBytes);
+		string result;
+		try
+		{
+			if (EBMLJournal::Recover(file) != replayed)
+				result = replayed ? "not replayed" : "replayed";
+			else if (ReadFile(file) != expected)
+				result = "file content differs";
+			else if (access(journal.c_str(), F_OK) == 0)
+				result = "journal left behind";
+		}
+		catch (std::exception & e)
+		{
+			result = string("threw ") + e.what();
+		}
+		if (!result.empty())
+			cout << "FAILED " << name << ": " << result << std::endl;
+		failures += !result.empty();
+		return result.empty();
+	};
+	auto report = [&](const string & name, bool passed) { if (passed) cout << "ok     " << name << std::endl; };
+
+	report("committed journal is replayed", check("committed journal is replayed", committed, true, applied));
+
+	{
+		// A crash during the replay leaves a partly patched file and the journal: replaying again completes it
+		WriteFile(file, applied);
+		WriteFile(journal, committed);
+		bool passed = EBMLJournal::Recover(file) && ReadFile(file) == applied;
+		cout << (passed ? "ok     " : "FAILED ") << "replay is idempotent" << std::endl;
+		failures += !passed;
+	}
+
+	bool torn = true;
+	for (size_t length = 0; length < committed.size(); length++)
+		torn &= check("torn at " + to_string(length) + " bytes", vector<uint8_t>(committed.begin(), committed.begin() + length), false, original);
+	report("torn journal is dropped at every length", torn);
+
+	bool mismatch = true;
+	for (size_t offset = 8; offset < committed.size() - 17; offset++)
+	{
+		vector<uint8_t> flipped(committed);
+		flipped[offset] ^= 0x10;
+		mismatch &= check("flipped byte " + to_string(offset), flipped, false, original);
+	}
+	report("crc mismatch is dropped for every flipped record byte", mismatch);
+
+	{
+		vector<uint8_t> flipped(committed);
+		flipped[flipped.size() - 1] ^= 0x01; // The stored CRC itself
+		report("stored crc mismatch is dropped", check("stored crc mismatch is dropped", flipped, false, original));
+	}
+	{
+		vector<uint8_t> counted(committed);
+		counted[counted.size() - 9] ^= 0x01; // Record count
+		report("record count mismatch is dropped", check("record count mismatch is dropped", counted, false, original));
+	}
+	{
+		vector<uint8_t> trailing(committed);
+		trailing.push_back(0x00);
+		report("bytes behind the commit record are dropped", check("bytes behind the commit record are dropped", trailing, false, original));
+	}
+	{
+		vector<uint8_t> magic(committed);
+		magic[7] = '2';
+		report("unknown magic is dropped", check("unknown magic is dropped", magic, false, original));
+	}
+	{
+		vector<Record> oversized = { { 0x01, 10, 1000, "HELLO" } }; // Data length past the end of the journal
+		report("data record past the end is dropped", check("data record past the end is dropped", BuildJournal(oversized), false, original));
+	}
+
+	{
+		WriteFile(file, original);
+		unlink(journal.c_str());
+		bool passed = !EBMLJournal::Recover(file) && ReadFile(file) == original;
+		cout << (passed ? "ok     " : "FAILED ") << "no journal, nothing to recover" << std::endl;
+		failures += !passed;
+	}
+	{
+		// Commit journals, applies and removes the journal
+		WriteFile(file, original);
+		EBMLJournal writer(file);
+		writer.Add(10, (const uint8_t *) "HELLO", 5);
+		writer.AddZeros(30, 6);
+		writer.Add(62, (const uint8_t *) "WXYZ", 4);
+		writer.Commit();
+		bool passed = ReadFile(file) == applied && access(journal.c_str(), F_OK) != 0 && writer.Empty();
+		cout << (passed ? "ok     " : "FAILED ") << "commit applies the writes" << std::endl;
+		failures += !passed;
+	}
+
+	unlink(file.c_str());
+	unlink(journal.c_str());
+	rmdir(directory);
+	cout << std::endl << failures << " failed." << std::endl;
+	return failures > 0;
+}
\ No newline at end of file
@@ -0,0 +1,106 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <EBMLTools/EBMLPatternScanner.hpp>
+
+using namespace EBMLTools;
+using namespace std;
+
+const vector<uint64_t> IDS = { 0x1F43B675, 0x1C53BB6B, 0x1254C367 };
+
+// Mostly bytes of the IDs, so the first two bytes of one often match without the rest
+vector<uint8_t> Pattern(size_t length, uint32_t seed)
+{
+	const uint8_t alphabet[] = { 0x1F, 0x43, 0xB6, 0x75, 0x1C, 0x53, 0xBB, 0x6B, 0x12, 0x54, 0xC3, 0x67, 0x00 };
+	vector<uint8_t> bytes(length);
+	for (auto & byte : bytes)
+	{
+		seed = seed * 1103515245 + 12345;
+		byte = (seed >> 16) % 4 == 0 ? (uint8_t) (seed >> 8) : alphabet[(seed >> 20) % sizeof(alphabet)];
+	}
+	return bytes;
+}
+
+void Plant(vector<uint8_t> & bytes, size_t offset, uint64_t id)
+{
+	for (size_t i = 0; i < 4 && offset + i < bytes.size(); i++)
+		bytes[offset + i] = (uint8_t) (id >> (24 - 8 * i));
+}
+
+// Every match, found the way EBMLDurationEstimator scans: from one past the previous match on, in an exactly sized
+// heap copy so a read past the buffer is caught by a sanitizer build
+vector<pair<size_t, size_t>> Matches(const EBMLPatternScanner & scanner, const vector<uint8_t> & bytes)
+{
+	uint8_t * data = new uint8_t[bytes.size()];
+	copy(bytes.begin(), bytes.end(), data);
+	vector<pair<size_t, size_t>> matches;
+	size_t index;
+	for (size_t offset = 0, match; offset < bytes.size() && (match = scanner.Find(data + offset, bytes.size() - offset, index)) != EBMLPatternScanner::NotFound; offset += match + 1)
+		matches.push_back({ offset + match, index });
+	delete[] data;
+	return matches;
+}
+
+int main()
+{
+	EBMLPatternScanner scalar(IDS);
+	scalar.SetImplementation(EBMLPatternScanner::Implementation::Scalar);
+
+	size_t failures = 0;
+	for (auto implementation : { EBMLPatternScanner::Implementation::SSE2, EBMLPatternScanner::Implementation::AVX2 })
+	{
+		string name = implementation == EBMLPatternScanner::Implementation::SSE2 ? "SSE2" : "AVX2";
+		EBMLPatternScanner scanner(IDS);
+		scanner.SetImplementation(implementation);
+		if (scanner.GetImplementation() != implementation)
+		{
+			cout << "skip   " << name << " is not supported by this CPU" << std::endl;
+			continue;
+		}
+
+		// Lengths around the 16 and 32 byte blocks and the 3 bytes an ID reaches past its first, IDs planted at every
+		// offset of the first blocks, next to each block edge and at the end of the buffer (one cut off by it)
+		string result;
+		size_t buffers = 0;
+		for (size_t length = 0; length < 200 && result.empty(); length++)
+			for (uint32_t seed = 0; seed < 20 && result.empty(); seed++)
+			{
+				vector<size_t> offsets;
+				for (size_t offset = 0; offset < 70; offset++)
+					offsets.push_back(offset);
+				for (size_t edge = 16; edge < length + 4; edge += 16)
+					for (size_t offset = edge - 4; offset <= edge + 1; offset++)
+						offsets.push_back(offset);
+				for (size_t back = 1; back <= 6 && back <= length; back++)
+					offsets.push_back(length - back);
+				for (size_t offset : offsets)
+				{
+					if (offset >= length)
+						continue;
+					vector<uint8_t> bytes = Pattern(length, seed * 1000 + (uint32_t) length);
+					Plant(bytes, offset, IDS[(offset + seed) % IDS.size()]);
+					if ((seed & 1) && offset + 40 < length)
+						Plant(bytes, offset + 32 + seed % 8, IDS[seed % IDS.size()]); // A second one in a later block
+					auto expected = Matches(scalar, bytes), found = Matches(scanner, bytes);
+					buffers++;
+					if (found != expected)
+					{
+						result = to_string(found.size()) + " matches instead of " + to_string(expected.size()) + " in " + to_string(length) + " bytes with an ID at " + to_string(offset);
+						break;
+					}
+				}
+			}
+		for (size_t length : { 4096, 65536 + 7 })
+			if (result.empty())
+			{
+				vector<uint8_t> bytes = Pattern(length, (uint32_t) length);
+				if (Matches(scanner, bytes) != Matches(scalar, bytes))
+					result = "matches differ in " + to_string(length) + " random bytes";
+				buffers++;
+			}
+		cout << (result.empty() ? "ok     " : "FAILED ") << name << " matches scalar in " << buffers << " buffers" << (result.empty() ? "" : ": " + result) << std::endl;
+		failures += !result.empty();
+	}
+	cout << std::endl << failures << " failed." << std::endl;
+	return failures > 0;
+}
\ No newline at end of file
@@ -0,0 +1,586 @@
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <EBMLTools/EBMLElement.hpp>
+#include <EBMLTools/EBMLExtractor.hpp>
+#include <EBMLTools/EBMLFileWindow.hpp>
+#include <EBMLTools/EBMLLayoutOptimizer.hpp>
+#include <EBMLTools/EBMLParser.hpp>
+#include <EBMLTools/EBMLStreamWriter.hpp>
+
+using namespace EBMLTools;
+using namespace std;
+
+// Level 1 element of a generated file: a Void of size bytes in total, Info with a Title of size characters,
+// Tracks with a CodecName of size characters, Tags with a TagString of size characters, a Cluster with a
+// SimpleBlock of size payload bytes, or Cues with a CuePoint per Cluster
+struct Item
+{
+	string name;
+	size_t size;
+};
+
+struct Node
+{
+	uint64_t id;
+	size_t position;
+	size_t dataPosition;
+	size_t dataSize;
+};
+
+vector<uint8_t> Pattern(size_t length, uint32_t seed)
+{
+	vector<uint8_t> bytes(length);
+	for (auto & byte : bytes)
+	{
+		seed = seed * 1103515245 + 12345;
+		byte = (uint8_t) (seed >> 16);
+	}
+	return bytes;
+}
+
+vector<uint8_t> ReadFile(const string & path)
+{
+	ifstream in(path, ios::binary);
+	return vector<uint8_t>(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+}
+
+const EBMLElement & E(const string & name) { return EBMLElement::Find(name); }
+
+// Size field width EBMLWriteElement::Validate picks
+size_t SizeLength(uint64_t size)
+{
+	size_t sizeLength = 1;
+	while (sizeLength < 8 && size >= (uint64_t(1) << (7 * sizeLength)) - 2)
+		sizeLength++;
+	return sizeLength;
+}
+
+// Written with EBMLStreamWriter until the SeekPositions and CueClusterPositions, which depend on the
+// positions they are written for, settle. Masters get 4 byte sizes, the SeekHead seekHeadSizeLength (0 for none).
+// Tags is written as EBMLWriteElement would, so an unchanged copy of it serializes to the same bytes
+void Build(const string & path, const vector<Item> & items, size_t seekHeadSizeLength = 1)
+{
+	map<string, uint64_t> guessed, actual; // Item name (Clusters numbered), relative position
+	for (size_t pass = 0; pass == 0 || actual != guessed; pass++)
+	{
+		if (pass == 8)
+			throw runtime_error("Build(). Positions do not settle.");
+		guessed = actual;
+		actual.clear();
+		int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+		EBMLStreamWriter writer(fd, 0);
+		writer.BeginMaster(E("EBML"), 1);
+		writer.WriteUint(E("EBMLVersion"), 1);
+		writer.WriteUint(E("EBMLMaxSizeLength"), 8);
+		writer.WriteString(E("DocType"), "matroska");
+		writer.EndMaster();
+		writer.BeginMaster(E("Segment"));
+		size_t dataPosition = writer.GetPosition();
+		if (seekHeadSizeLength > 0)
+		{
+			writer.BeginMaster(E("SeekHead"), seekHeadSizeLength);
+			for (auto & item : items)
+				if (item.name != "Void" && item.name != "Cluster")
+				{
+					writer.BeginMaster(E("Seek"), 1);
+					writer.WriteUint(E("SeekID"), E(item.name).GetElementId());
+					writer.WriteUint(E("SeekPosition"), guessed[item.name]);
+					writer.EndMaster();
+				}
+			writer.EndMaster();
+		}
+		size_t clusters = 0;
+		for (auto & item : items)
+		{
+			size_t position = writer.GetPosition();
+			if (item.name == "Void")
+			{
+				size_t sizeLength = 1;
+				while (item.size - 1 - sizeLength >= (uint64_t(1) << (7 * sizeLength)) - 1)
+					sizeLength++;
+				vector<uint8_t> zeros(item.size - 1 - sizeLength, 0);
+				writer.WriteBinary(E("Void"), zeros.data(), zeros.size());
+				if (writer.GetPosition() != position + item.size)
+					throw runtime_error("Build(). No Void of " + to_string(item.size) + " bytes.");
+				continue;
+			}
+			if (item.name == "Cluster")
+			{
+				actual["Cluster" + to_string(clusters)] = position - dataPosition;
+				writer.BeginMaster(E("Cluster"), 4);
+				writer.WriteUint(E("Timecode"), clusters * 1000);
+				vector<uint8_t> block = { 0x81, 0x00, 0x00, 0x80 };
+				vector<uint8_t> payload = Pattern(item.size, clusters);
+				block.insert(block.end(), payload.begin(), payload.end());
+				writer.WriteBinary(E("SimpleBlock"), block.data(), block.size());
+				writer.EndMaster();
+				clusters++;
+				continue;
+			}
+			actual[item.name] = position - dataPosition;
+			size_t tagString = 2 + SizeLength(item.size) + item.size, simpleTag = 8 + tagString, tag = 2 + SizeLength(simpleTag) + simpleTag;
+			writer.BeginMaster(E(item.name), item.name == "Tags" ? SizeLength(4 + SizeLength(tag) + tag) : 4);
+			if (item.name == "Info")
+			{
+				writer.WriteUint(E("TimecodeScale"), 1000000);
+				writer.WriteString(E("Title"), string(item.size, 't'));
+			}
+			else if (item.name == "Tracks")
+			{
+				writer.BeginMaster(E("TrackEntry"), 4);
+				writer.WriteUint(E("TrackNumber"), 1);
+				writer.WriteUint(E("TrackUID"), 1);
+				writer.WriteUint(E("TrackType"), 1);
+				writer.WriteString(E("CodecID"), "V_TEST");
+				writer.WriteString(E("CodecName"), string(item.size, 'c'));
+				writer.EndMaster();
+			}
+			else if (item.name == "Tags")
+			{
+				writer.BeginMaster(E("Tag"), SizeLength(tag));
+				writer.BeginMaster(E("SimpleTag"), SizeLength(simpleTag));
+				writer.WriteString(E("TagName"), "TITLE");
+				writer.WriteString(E("TagString"), string(item.size, 's'));
+				writer.EndMaster();
+				writer.EndMaster();
+			}
+			else if (item.name == "Cues")
+				for (size_t i = 0; i < clusters; i++)
+				{
+					writer.BeginMaster(E("CuePoint"), 4);
+					writer.WriteUint(E("CueTime"), i * 1000);
+					writer.BeginMaster(E("CueTrackPositions"), 4);
+					writer.WriteUint(E("CueTrack"), 1);
+					writer.WriteUint(E("CueClusterPosition"), guessed["Cluster" + to_string(i)]);
+					writer.EndMaster();
+					writer.EndMaster();
+				}
+			writer.EndMaster();
+		}
+		writer.EndMaster();
+		writer.Flush();
+		close(fd);
+	}
+}
+
+uint64_t ReadUint(const vector<uint8_t> & bytes, const Node & node)
+{
+	uint64_t value = 0;
+	for (size_t i = 0; i < node.dataSize; i++)
+		value = (value << 8) | bytes[node.dataPosition + i];
+	return value;
+}
+
+vector<Node> Children(const vector<uint8_t> & bytes, size_t start, size_t end)
+{
+	vector<Node> children;
+	for (size_t position = start; position < end; )
+	{
+		EBMLFileWindow::Header header;
+		if (!EBMLFileWindow::ParseHeader(bytes.data() + position, end - position, header) || header.unknownSize || header.dataSize > end - position - header.headerLength)
+			throw runtime_error("no element at " + to_string(position));
+		children.push_back({ header.id, position, position + header.headerLength, header.dataSize });
+		position += header.headerLength + header.dataSize;
+	}
+	return children;
+}
+
+vector<Node> Children(const vector<uint8_t> & bytes, const Node & parent) { return Children(bytes, parent.dataPosition, parent.dataPosition + parent.dataSize); }
+
+Node Child(const vector<Node> & nodes, const string & name)
+{
+	for (auto & node : nodes)
+		if (node.id == E(name).GetElementId())
+			return node;
+	throw runtime_error("no " + name);
+}
+
+Node Segment(const vector<uint8_t> & bytes)
+{
+	vector<Node> root = Children(bytes, 0, bytes.size());
+	if (root.size() != 2 || root[1].id != E("Segment").GetElementId())
+		throw runtime_error("no EBML header and Segment");
+	return root[1];
+}
+
+// The whole file parses, every SeekPosition points at an element of its SeekID and every CueClusterPosition at a
+// Cluster whose Timecode is the CueTime; empty or what is wrong
+string CheckOffsets(const vector<uint8_t> & bytes)
+{
+	try
+	{
+		Node segment = Segment(bytes);
+		vector<Node> level1 = Children(bytes, segment);
+		map<size_t, const Node *> at;
+		for (auto & node : level1)
+			at[node.position - segment.dataPosition] = &node;
+		for (auto & node : level1)
+		{
+			if (node.id == E("SeekHead").GetElementId())
+				for (auto & seek : Children(bytes, node))
+				{
+					vector<Node> fields = Children(bytes, seek);
+					uint64_t id = ReadUint(bytes, Child(fields, "SeekID")), position = ReadUint(bytes, Child(fields, "SeekPosition"));
+					if (!at.count(position) || at[position]->id != id)
+						return "Seek " + to_string(id) + " does not point at its element";
+				}
+			if (node.id == E("Cues").GetElementId())
+				for (auto & point : Children(bytes, node))
+				{
+					vector<Node> fields = Children(bytes, point);
+					uint64_t time = ReadUint(bytes, Child(fields, "CueTime"));
+					uint64_t position = ReadUint(bytes, Child(Children(bytes, Child(fields, "CueTrackPositions")), "CueClusterPosition"));
+					if (!at.count(position) || at[position]->id != E("Cluster").GetElementId())
+						return "CuePoint " + to_string(time) + " does not point at a Cluster";
+					if (ReadUint(bytes, Child(Children(bytes, *at[position]), "Timecode")) != time)
+						return "CuePoint " + to_string(time) + " points at the wrong Cluster";
+				}
+		}
+	}
+	catch (std::exception & e)
+	{
+		return e.what();
+	}
+	return "";
+}
+
+// Data of every level 1 element but SeekHeads and Voids, in file order
+vector<vector<uint8_t>> Contents(const vector<uint8_t> & bytes)
+{
+	vector<vector<uint8_t>> contents;
+	Node segment = Segment(bytes);
+	for (auto & node : Children(bytes, segment))
+		if (node.id != E("SeekHead").GetElementId() && node.id != E("Void").GetElementId())
+			contents.emplace_back(bytes.begin() + node.dataPosition, bytes.begin() + node.dataPosition + node.dataSize);
+	return contents;
+}
+
+template <typename Exception, typename Action>
+bool Throws(Action action)
+{
+	try
+	{
+		action();
+	}
+	catch (Exception &)
+	{
+		return true;
+	}
+	return false;
+}
+
+int main()
+{
+	char directory[] = "/tmp/rewritetest.XXXXXX";
+	if (mkdtemp(directory) == NULL)
+	{
+		cout << "Unable to create a temporary directory." << std::endl;
+		return 1;
+	}
+	string file = string(directory) + "/test.mkv";
+
+	size_t failures = 0;
+	auto report = [&](const string & name, const string & result) {
+		cout << (result.empty() ? "ok     " : "FAILED ") << name << (result.empty() ? "" : ": " + result) << std::endl;
+		failures += !result.empty();
+	};
+
+	// Compaction: the elements in front of the split are packed behind the SeekHead, the others against the first Cluster
+	struct Compact
+	{
+		string name;
+		vector<Item> items;
+		size_t seekHeadSizeLength;
+		size_t voids;
+		size_t freeBytes;
+		vector<size_t> moved;	// Indexes into items of the elements that must move
+	};
+	vector<Compact> compactions = {
+		{ "compaction packs to the front", { { "Void", 40 }, { "Info", 10 }, { "Tracks", 5 }, { "Void", 3 }, { "Tags", 200 }, { "Cluster", 100 }, { "Cluster", 100 }, { "Cues", 0 } }, 1, 2, 43, { 1, 2 } },
+		{ "compaction leaves the large element behind the split", { { "Void", 40 }, { "Info", 10 }, { "Void", 3 }, { "Tags", 2000 }, { "Cluster", 100 }, { "Cues", 0 } }, 1, 2, 43, { 1 } },
+		{ "compaction splits between Voids", { { "Info", 10 }, { "Void", 20 }, { "Tracks", 30 }, { "Void", 20 }, { "Tags", 300 }, { "Void", 20 }, { "Cluster", 100 } }, 1, 3, 60, { 2, 4 } },
+		{ "compaction without a SeekHead", { { "Void", 40 }, { "Info", 10 }, { "Void", 5 }, { "Tags", 20 }, { "Cluster", 100 } }, 0, 2, 45, { 1 } },
+		{ "compaction with a single byte left widens the SeekHead size", { { "Info", 10 }, { "Tracks", 5 }, { "Tags", 20 }, { "Cluster", 100 }, { "Cues", 0 } }, 2, 0, 0, { } },
+	};
+	for (auto & test : compactions)
+	{
+		string result;
+		try
+		{
+			Build(file, test.items, test.seekHeadSizeLength);
+			vector<uint8_t> before = ReadFile(file);
+			EBMLParser::Compaction compaction;
+			{
+				EBMLParser parser(file);
+				compaction = parser.CompactMetadata();
+			}
+			vector<uint8_t> after = ReadFile(file);
+
+			// Level 1 positions of the metadata elements, before and after
+			Node segmentBefore = Segment(before), segmentAfter = Segment(after);
+			vector<Node> level1Before = Children(before, segmentBefore), level1After = Children(after, segmentAfter);
+			map<uint64_t, size_t> positionsBefore, positionsAfter;
+			for (auto & node : level1Before)
+				positionsBefore.insert({ node.id, node.position });
+			size_t voids = 0, freeBytes = 0;
+			for (auto & node : level1After)
+			{
+				positionsAfter.insert({ node.id, node.position });
+				if (node.id == E("Void").GetElementId() && !positionsAfter.count(E("Cluster").GetElementId()))
+				{
+					voids++;
+					freeBytes += node.dataPosition - node.position + node.dataSize;
+				}
+			}
+			size_t movedBytes = 0;
+			for (size_t i = 0; i < test.items.size(); i++)
+			{
+				uint64_t id = E(test.items[i].name).GetElementId();
+				bool shouldMove = find(test.moved.begin(), test.moved.end(), i) != test.moved.end();
+				if (test.items[i].name != "Void" && test.items[i].name != "Cluster" && (positionsBefore[id] != positionsAfter[id]) != shouldMove)
+					result = test.items[i].name + (shouldMove ? " was not moved" : " was moved");
+				if (shouldMove)
+					movedBytes += Child(level1Before, test.items[i].name).dataPosition + Child(level1Before, test.items[i].name).dataSize - positionsBefore[id];
+			}
+			if (result.empty())
+				result = CheckOffsets(after);
+			if (result.empty() && after.size() != before.size())
+				result = "file size changed from " + to_string(before.size()) + " to " + to_string(after.size());
+			if (result.empty() && Contents(after) != Contents(before))
+				result = "element data changed";
+			if (result.empty() && (compaction.voids != test.voids || compaction.freeBytes != test.freeBytes || compaction.movedBytes != movedBytes))
+				result = "reported " + to_string(compaction.voids) + " Voids, " + to_string(compaction.freeBytes) + " free and " + to_string(compaction.movedBytes) + " moved bytes";
+			if (result.empty() && (voids != (test.freeBytes > 0) || freeBytes != test.freeBytes))
+				result = to_string(voids) + " Voids of " + to_string(freeBytes) + " bytes left in front of the Clusters";
+		}
+		catch (std::exception & e)
+		{
+			result = string("threw ") + e.what();
+		}
+		report(test.name, result);
+	}
+
+	// In place rewrite: only the changed ranges are written, merged when at most the merge gap apart. Changes sit at
+	// offsets from the start of Tags around the 4 KiB pages and the 1 MiB blocks it is compared in
+	const size_t tagLength = 1024 * 1024 + 5000;
+	struct Diff
+	{
+		vector<size_t> offsets;
+		vector<size_t> mergeGaps;
+	};
+	vector<Diff> diffs = {
+		{ { 4095 }, { 0 } },
+		{ { 4096 }, { 0 } },
+		{ { 4095, 4096 }, { 0, 1, 4096 } },
+		{ { 4000, 4097 }, { 0, 95, 96, 97 } },
+		{ { 100, 8191, 8192, 12288 }, { 0, 4095, 4096, 1 << 30 } },
+		{ { 1048575, 1048576 }, { 0, 4096 } },
+		{ { 1048000, 1049000, 1050000 }, { 0, 999, 1000, 4096 } },
+		{ { 30, tagLength + 29 }, { 0, 4096, 1 << 30 } },	// First and last byte of the TagString
+	};
+	for (auto & test : diffs)
+		for (size_t mergeGap : test.mergeGaps)
+		{
+			string name = "rewrite in place at";
+			for (size_t offset : test.offsets)
+				name += " " + to_string(offset);
+			name += ", merge gap " + to_string(mergeGap);
+			string result;
+			try
+			{
+				Build(file, { { "Void", 10 }, { "Info", 10 }, { "Tags", tagLength }, { "Cluster", 100 } });
+				vector<uint8_t> expected = ReadFile(file);
+				Node tags = Child(Children(expected, Segment(expected)), "Tags");
+				Node tagString = Child(Children(expected, Child(Children(expected, Child(Children(expected, tags), "Tag")), "SimpleTag")), "TagString");
+				string value(expected.begin() + tagString.dataPosition, expected.begin() + tagString.dataPosition + tagString.dataSize);
+				for (size_t offset : test.offsets)
+				{
+					if (tags.position + offset < tagString.dataPosition || tags.position + offset >= tagString.dataPosition + tagString.dataSize)
+						throw runtime_error("offset " + to_string(offset) + " is not in the TagString");
+					value[tags.position + offset - tagString.dataPosition] = 'x';
+					expected[tags.position + offset] = 'x';
+				}
+
+				EBMLParser parser(file);
+				parser.SetMergeGap(mergeGap);
+				EBMLReadElement element = parser.GetRootElements(E("Segment")).at(0).FindFirstChild(E("Tags"));
+				EBMLWriteElement unchanged(element);
+				EBMLWriteElement changed(element);
+				changed.Children()[0]->Children()[0]->Children(E("TagString"))[0]->SetStringData(value);
+				if (parser.UpdateElement(element, unchanged) != EBMLParser::UpdateResult::Unchanged)
+					result = "an unchanged element was written";
+				else if (parser.UpdateElement(element, changed) != EBMLParser::UpdateResult::InPlace)
+					result = "not rewritten in place";
+				else if (ReadFile(file) != expected)
+					result = "file content differs";
+			}
+			catch (std::exception & e)
+			{
+				result = string("threw ") + e.what();
+			}
+			report(name, result);
+		}
+
+	// Extraction: the Clusters of 2 s up to 4 s, rebased to 0 or not, with the metadata and new Cues and SeekHead. The output
+	// is reopened and every offset in it checked
+	string output = string(directory) + "/out.mkv";
+	for (bool rebase : { true, false })
+	{
+		string result;
+		try
+		{
+			vector<Item> items = { { "Info", 10 }, { "Tracks", 5 }, { "Tags", 200 }, { "Void", 50 } };
+			for (size_t i = 0; i < 6; i++)
+				items.push_back({ "Cluster", 100 + i * 30 });
+			items.push_back({ "Cues", 0 });
+			Build(file, items);
+			vector<uint8_t> source = ReadFile(file);
+			EBMLExtractor::Result extraction;
+			{
+				EBMLParser parser(file);
+				EBMLExtractor extractor(parser);
+				extractor.SetRebase(rebase);
+				extraction = extractor.Extract(output, 2000000000, 4000000000);
+			}
+			vector<uint8_t> extracted = ReadFile(output);
+			result = CheckOffsets(extracted);
+
+			vector<Node> level1Source = Children(source, Segment(source)), level1 = Children(extracted, Segment(extracted));
+			Child(level1, "SeekHead");
+			Child(level1, "Cues");
+			vector<Node> clustersSource, clusters;
+			for (auto & node : level1Source)
+				if (node.id == E("Cluster").GetElementId())
+					clustersSource.push_back(node);
+			for (auto & node : level1)
+				if (node.id == E("Cluster").GetElementId())
+					clusters.push_back(node);
+			if (result.empty() && (clusters.size() != 2 || extraction.clusters != 2 || extraction.firstTimecode != 2000 || extraction.lastTimecode != 3000 || extraction.cuePoints != 2))
+				result = to_string(clusters.size()) + " Clusters written, " + to_string(extraction.clusters) + " from " + to_string(extraction.firstTimecode) + " to " + to_string(extraction.lastTimecode) + " reported with " + to_string(extraction.cuePoints) + " CuePoints";
+			for (size_t i = 0; result.empty() && i < clusters.size(); i++)
+			{
+				vector<Node> fields = Children(extracted, clusters[i]), fieldsSource = Children(source, clustersSource[2 + i]);
+				Node block = Child(fields, "SimpleBlock"), blockSource = Child(fieldsSource, "SimpleBlock");
+				if (ReadUint(extracted, Child(fields, "Timecode")) != (rebase ? 0 : 2000) + i * 1000)
+					result = "Cluster " + to_string(i) + " has the Timecode " + to_string(ReadUint(extracted, Child(fields, "Timecode")));
+				else if (!equal(extracted.begin() + block.position, extracted.begin() + block.dataPosition + block.dataSize, source.begin() + blockSource.position, source.begin() + blockSource.dataPosition + blockSource.dataSize))
+					result = "Cluster " + to_string(i) + " has other blocks";
+			}
+			// Info gets the Duration up to the last block, Title and TimecodeScale are kept
+			vector<Node> info = Children(extracted, Child(level1, "Info")), infoSource = Children(source, Child(level1Source, "Info"));
+			vector<Node> parts = { Child(level1, "Tracks"), Child(level1, "Tags"), Child(info, "Title"), Child(info, "TimecodeScale") };
+			vector<Node> partsSource = { Child(level1Source, "Tracks"), Child(level1Source, "Tags"), Child(infoSource, "Title"), Child(infoSource, "TimecodeScale") };
+			for (size_t i = 0; i < parts.size(); i++)
+				if (result.empty() && !equal(extracted.begin() + parts[i].position, extracted.begin() + parts[i].dataPosition + parts[i].dataSize, source.begin() + partsSource[i].position, source.begin() + partsSource[i].dataPosition + partsSource[i].dataSize))
+					result = EBMLElement::Find(parts[i].id).GetElementName() + " changed";
+			Node duration = Child(info, "Duration");
+			uint64_t durationBits = ReadUint(extracted, duration);
+			double durationValue = 0;
+			if (duration.dataSize == 8)
+				memcpy(&durationValue, &durationBits, 8);
+			else if (duration.dataSize == 4)
+			{
+				uint32_t bits = (uint32_t) durationBits;
+				float value;
+				memcpy(&value, &bits, 4);
+				durationValue = value;
+			}
+			if (result.empty() && durationValue != (rebase ? 1000 : 3000))
+				result = "Duration " + to_string(durationValue) + " is not the time of the last block";
+			if (result.empty() && extraction.fileSize != extracted.size())
+				result = "reported a file size of " + to_string(extraction.fileSize) + " for " + to_string(extracted.size()) + " bytes";
+		}
+		catch (std::exception & e)
+		{
+			result = string("threw ") + e.what();
+		}
+		unlink(output.c_str());
+		report(string("extraction of 2 s to 4 s") + (rebase ? " rebased to 0" : " keeping the timestamps"), result);
+	}
+
+	// Layout optimization: metadata found behind and between the Clusters is moved in front of them, the Clusters keep
+	// their order and bytes, runs of adjacent Clusters are copied at once
+	struct Layout
+	{
+		string name;
+		vector<Item> items;
+		size_t copies;
+	};
+	vector<Layout> layouts = {
+		{ "layout with the metadata behind the Clusters", { { "Cluster", 100 }, { "Cluster", 300 }, { "Cluster", 50 }, { "Info", 10 }, { "Tracks", 5 }, { "Tags", 200 }, { "Cues", 0 } }, 1 },
+		{ "layout with metadata and Voids between the Clusters", { { "Info", 10 }, { "Cluster", 100 }, { "Tags", 2000 }, { "Cluster", 300 }, { "Void", 30 }, { "Cluster", 50 }, { "Tracks", 5 }, { "Cues", 0 } }, 3 },
+	};
+	for (auto & test : layouts)
+	{
+		string result;
+		try
+		{
+			Build(file, test.items);
+			vector<uint8_t> source = ReadFile(file);
+			EBMLLayoutOptimizer::Result layout;
+			{
+				EBMLParser parser(file);
+				EBMLLayoutOptimizer optimizer(parser);
+				optimizer.SetPadding(1000);
+				layout = optimizer.Write(output);
+			}
+			vector<uint8_t> written = ReadFile(output);
+			result = CheckOffsets(written);
+
+			// Metadata first (the SeekHead leading), then the padding, then only Clusters
+			vector<vector<uint8_t>> metadata, metadataSource, clusters, clustersSource;
+			vector<Node> level1 = Children(written, Segment(written));
+			size_t firstCluster = level1.size();
+			for (size_t i = 0; i < level1.size(); i++)
+			{
+				vector<uint8_t> data(written.begin() + level1[i].dataPosition, written.begin() + level1[i].dataPosition + level1[i].dataSize);
+				if (level1[i].id == E("Cluster").GetElementId())
+				{
+					firstCluster = min(firstCluster, i);
+					clusters.push_back(data);
+				}
+				else if (result.empty() && firstCluster < level1.size())
+					result = EBMLElement::Find(level1[i].id).GetElementName() + " behind a Cluster";
+				else if (level1[i].id != E("SeekHead").GetElementId() && level1[i].id != E("Void").GetElementId())
+					metadata.push_back(data);
+			}
+			if (result.empty() && (level1.at(0).id != E("SeekHead").GetElementId() || level1.at(firstCluster - 1).id != E("Void").GetElementId() || level1[firstCluster].position - level1[firstCluster - 1].position != 1000))
+				result = "no SeekHead in front and 1000 byte Void behind the metadata";
+			for (auto & node : Children(source, Segment(source)))
+				if (node.id == E("Cluster").GetElementId())
+					clustersSource.emplace_back(source.begin() + node.dataPosition, source.begin() + node.dataPosition + node.dataSize);
+				else if (node.id != E("SeekHead").GetElementId() && node.id != E("Void").GetElementId() && node.id != E("Cues").GetElementId())
+					metadataSource.emplace_back(source.begin() + node.dataPosition, source.begin() + node.dataPosition + node.dataSize);
+			// Cues are rewritten for the new Cluster positions
+			Node cues = Child(level1, "Cues");
+			metadata.erase(find(metadata.begin(), metadata.end(), vector<uint8_t>(written.begin() + cues.dataPosition, written.begin() + cues.dataPosition + cues.dataSize)));
+			sort(metadata.begin(), metadata.end());
+			sort(metadataSource.begin(), metadataSource.end());
+			if (result.empty() && metadata != metadataSource)
+				result = "metadata changed";
+			if (result.empty() && clusters != clustersSource)
+				result = "Clusters changed";
+			if (result.empty() && (layout.clusters != clusters.size() || layout.copies != test.copies || layout.fileSize != written.size() || layout.metadataLength != level1[firstCluster].position - level1[0].position))
+				result = "reported " + to_string(layout.clusters) + " Clusters in " + to_string(layout.copies) + " copies, " + to_string(layout.metadataLength) + " bytes of metadata and " + to_string(layout.fileSize) + " in total";
+		}
+		catch (std::exception & e)
+		{
+			result = string("threw ") + e.what();
+		}
+		unlink(output.c_str());
+		report(test.name, result);
+	}
+
+	unlink(file.c_str());
+	rmdir(directory);
+	cout << std::endl << failures << " failed." << std::endl;
+	return failures > 0;
+}
\ No newline at end of file
@@ -0,0 +1,221 @@
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <CRC.hpp>
+#include <EBMLTools/EBMLElement.hpp>
+#include <EBMLTools/EBMLFileWindow.hpp>
+#include <EBMLTools/EBMLStreamWriter.hpp>
+
+using namespace EBMLTools;
+using namespace std;
+
+vector<uint8_t> Pattern(size_t length, uint32_t seed)
+{
+	vector<uint8_t> bytes(length);
+	for (auto & byte : bytes)
+	{
+		seed = seed * 1103515245 + 12345;
+		byte = (uint8_t) (seed >> 16);
+	}
+	return bytes;
+}
+
+vector<uint8_t> ReadFile(const string & path)
+{
+	ifstream in(path, ios::binary);
+	return vector<uint8_t>(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+}
+
+// Nested masters with CRCs, at several size widths, around a binary copied from a file and one read from a pipe to
+// its end. With a small buffer most sizes and CRCs are patched after their bytes were written, with a large one in memory
+void Write(const string & path, const string & source, const vector<uint8_t> & piped, size_t bufferSize)
+{
+	int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	EBMLStreamWriter writer(fd, 0);
+	writer.SetBufferSize(bufferSize);
+
+	writer.BeginMaster(EBMLElement::Find("EBML"), 2);
+	writer.WriteUint(EBMLElement::Find("EBMLVersion"), 1);
+	writer.WriteUint(EBMLElement::Find("EBMLMaxSizeLength"), 8);
+	writer.WriteString(EBMLElement::Find("DocType"), "matroska");
+	writer.EndMaster();
+
+	writer.BeginMaster(EBMLElement::Find("Segment"));
+	writer.BeginMaster(EBMLElement::Find("Info"), 4, true);
+	writer.WriteUint(EBMLElement::Find("TimecodeScale"), 1000000);
+	writer.WriteFloat(EBMLElement::Find("Duration"), 1234.5);
+	writer.WriteString(EBMLElement::Find("Title"), "streamed");
+	writer.WriteInt(EBMLElement::Find("DateUTC"), -86400000000000LL);
+	writer.EndMaster();
+
+	writer.BeginMaster(EBMLElement::Find("Attachments"), 8, true);
+	writer.BeginMaster(EBMLElement::Find("AttachedFile"), 8, true);
+	writer.WriteString(EBMLElement::Find("FileName"), "file.bin");
+	int in = open(source.c_str(), O_RDONLY);
+	writer.WriteBinary(EBMLElement::Find("FileData"), in, 300000);
+	close(in);
+	writer.EndMaster();
+	writer.BeginMaster(EBMLElement::Find("AttachedFile"), 4, true);
+	writer.WriteString(EBMLElement::Find("FileName"), "pipe.bin");
+	int pipes[2];
+	if (pipe(pipes) != 0)
+		throw runtime_error("pipe() failed");
+	thread feeder([&]() {
+		for (size_t offset = 0; offset < piped.size(); offset += 1000)
+			if (write(pipes[1], piped.data() + offset, min<size_t>(1000, piped.size() - offset)) <= 0)
+				break;
+		close(pipes[1]);
+	});
+	writer.WriteBinary(EBMLElement::Find("FileData"), pipes[0]);
+	feeder.join();
+	close(pipes[0]);
+	writer.EndMaster();
+	writer.EndMaster();
+
+	writer.BeginMaster(EBMLElement::Find("Tags"), 1, true);
+	writer.BeginMaster(EBMLElement::Find("Tag"), 1);
+	writer.BeginMaster(EBMLElement::Find("SimpleTag"), 1, true);
+	writer.WriteString(EBMLElement::Find("TagName"), "TITLE");
+	writer.WriteString(EBMLElement::Find("TagString"), "streamed");
+	writer.EndMaster();
+	writer.EndMaster();
+	writer.EndMaster();
+	writer.EndMaster();
+	writer.Flush();
+	close(fd);
+}
+
+// Children fill every master exactly, and a leading CRC-32 matches the rest of the master (stored little endian)
+string Verify(const vector<uint8_t> & bytes, size_t start, size_t end, size_t & crcs)
+{
+	for (size_t position = start; position < end; )
+	{
+		EBMLFileWindow::Header header;
+		if (!EBMLFileWindow::ParseHeader(bytes.data() + position, end - position, header) || header.unknownSize)
+			return "no header at " + to_string(position);
+		size_t dataPosition = position + header.headerLength;
+		if (header.dataSize > end - dataPosition)
+			return "element at " + to_string(position) + " runs past its parent";
+		if (EBMLElement::Find(header.id).GetElementType() == Master)
+		{
+			EBMLFileWindow::Header child;
+			if (header.dataSize >= 6 && EBMLFileWindow::ParseHeader(bytes.data() + dataPosition, header.dataSize, child) && child.id == 0xBF)
+			{
+				uint32_t stored = bytes[dataPosition + 2] | (bytes[dataPosition + 3] << 8) | (bytes[dataPosition + 4] << 16) | ((uint32_t) bytes[dataPosition + 5] << 24);
+				if (stored != CRC::Calculate(bytes.data() + dataPosition + 6, header.dataSize - 6, CRC::CRC_32()))
+					return "wrong CRC-32 in " + EBMLElement::Find(header.id).GetElementName() + " at " + to_string(position);
+				crcs++;
+			}
+			string result = Verify(bytes, dataPosition, dataPosition + header.dataSize, crcs);
+			if (!result.empty())
+				return result;
+		}
+		position = dataPosition + header.dataSize;
+	}
+	return "";
+}
+
+bool Contains(const vector<uint8_t> & bytes, const vector<uint8_t> & part)
+{
+	return search(bytes.begin(), bytes.end(), part.begin(), part.end()) != bytes.end();
+}
+
+template <typename Exception, typename Action>
+bool Throws(Action action)
+{
+	try
+	{
+		action();
+	}
+	catch (Exception &)
+	{
+		return true;
+	}
+	return false;
+}
+
+int main()
+{
+	char directory[] = "/tmp/streamwritertest.XXXXXX";
+	if (mkdtemp(directory) == NULL)
+	{
+		cout << "Unable to create a temporary directory." << std::endl;
+		return 1;
+	}
+	string source = string(directory) + "/source.bin";
+	vector<uint8_t> attached = Pattern(300000, 1), piped = Pattern(150001, 2);
+	ofstream(source, ios::binary).write((const char *) attached.data(), attached.size());
+
+	size_t failures = 0;
+	auto report = [&](const string & name, const string & result) {
+		cout << (result.empty() ? "ok     " : "FAILED ") << name << (result.empty() ? "" : ": " + result) << std::endl;
+		failures += !result.empty();
+	};
+
+	vector<vector<uint8_t>> outputs;
+	for (size_t bufferSize : { (size_t) 4096, (size_t) 1024 * 1024 })
+	{
+		string path = string(directory) + "/out" + to_string(bufferSize) + ".mkv";
+		string result;
+		try
+		{
+			Write(path, source, piped, bufferSize);
+			vector<uint8_t> bytes = ReadFile(path);
+			size_t crcs = 0;
+			result = Verify(bytes, 0, bytes.size(), crcs);
+			if (result.empty() && crcs != 6)
+				result = to_string(crcs) + " CRC-32 elements instead of 6";
+			if (result.empty() && (!Contains(bytes, attached) || !Contains(bytes, piped)))
+				result = "binary data was not copied whole";
+			outputs.push_back(bytes);
+		}
+		catch (std::exception & e)
+		{
+			result = string("threw ") + e.what();
+		}
+		unlink(path.c_str());
+		report("sizes and CRCs with a " + to_string(bufferSize) + " byte buffer", result);
+	}
+	report("output does not depend on the buffer size", outputs.size() == 2 && outputs[0] == outputs[1] ? "" : "outputs differ");
+
+	{
+		string path = string(directory) + "/errors.mkv";
+		int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+		EBMLStreamWriter writer(fd, 0);
+		report("wrong element type throws", Throws<invalid_argument>([&]() { writer.WriteUint(EBMLElement::Find("Title"), 1); }) ? "" : "did not throw");
+		report("size width 9 throws", Throws<invalid_argument>([&]() { writer.BeginMaster(EBMLElement::Find("Tags"), 9); }) ? "" : "did not throw");
+		report("EndMaster without a master throws", Throws<logic_error>([&]() { writer.EndMaster(); }) ? "" : "did not throw");
+		report("data too large for its size width throws", Throws<runtime_error>([&]() {
+			writer.BeginMaster(EBMLElement::Find("Tags"), 1);
+			vector<uint8_t> data(200, 0);
+			writer.WriteBinary(EBMLElement::Find("TagBinary"), data.data(), data.size());
+			writer.EndMaster();
+		}) ? "" : "did not throw");
+		report("source shorter than its length throws", Throws<runtime_error>([&]() {
+			int in = open(source.c_str(), O_RDONLY);
+			try
+			{
+				writer.WriteBinary(EBMLElement::Find("FileData"), in, attached.size() + 1);
+			}
+			catch (...)
+			{
+				close(in);
+				throw;
+			}
+			close(in);
+		}) ? "" : "did not throw");
+		close(fd);
+		unlink(path.c_str());
+	}
+
+	unlink(source.c_str());
+	rmdir(directory);
+	cout << std::endl << failures << " failed." << std::endl;
+	return failures > 0;
+}
\ No newline at end of file